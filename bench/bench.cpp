@@ -0,0 +1,438 @@
+/**
+ * @file
+ *
+ * @brief Micro benchmarks for the decode, format, symbol lookup and config hot paths.
+ *
+ * @copyright Assemblize is free software: you can redistribute it and/or
+ *            modify it under the terms of the GNU General Public License
+ *            as published by the Free Software Foundation, either version
+ *            3 of the License, or (at your option) any later version.
+ *            A full copy of the GNU General Public License can be found in
+ *            LICENSE
+ */
+#include "executable.h"
+#include "function.h"
+#include "synthimage.h"
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <getopt.h>
+#include <inttypes.h>
+#include <nlohmann/json.hpp>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+namespace
+{
+const uint32_t IMAGE_BASE = 0x400000;
+const size_t CORPUS_INSTRUCTIONS = 16384;
+const size_t LOOKUPS_PER_RUN = 4096;
+const size_t SYMBOL_COUNTS[] = {1 << 10, 1 << 14, 1 << 18, 1 << 20};
+const size_t CONFIG_SYMBOL_COUNTS[] = {1 << 14, 1 << 18};
+
+/**
+ * Measures one benchmark run, which starts timing on entry. Setup inside a run can be left out with pause and resume.
+ */
+class Stopwatch
+{
+    using Clock = std::chrono::steady_clock;
+
+public:
+    Stopwatch() : m_elapsed(0), m_start(Clock::now()), m_running(true) {}
+
+    // Pausing or resuming twice does nothing, so a benchmark can stop the watch before the runner does.
+    void pause()
+    {
+        if (m_running) {
+            m_elapsed += Clock::now() - m_start;
+            m_running = false;
+        }
+    }
+
+    void resume()
+    {
+        if (!m_running) {
+            m_start = Clock::now();
+            m_running = true;
+        }
+    }
+
+    double seconds() const { return std::chrono::duration<double>(m_elapsed).count(); }
+
+private:
+    Clock::duration m_elapsed;
+    Clock::time_point m_start;
+    bool m_running;
+};
+
+struct Options
+{
+    const char *filter;
+    double min_time;
+    bool verbose;
+};
+
+/**
+ * Repeats a benchmark until it has run for the minimum time and records ns/op and ops/s. Ops are whatever the
+ * benchmark counts per run, instructions count the decoded instructions of disassembly benchmarks.
+ */
+class Runner
+{
+public:
+    Runner(const Options &options) : m_options(options), m_results(nlohmann::json::array()) {}
+
+    bool enabled(const std::string &name) const
+    {
+        return m_options.filter == nullptr || name.find(m_options.filter) != std::string::npos;
+    }
+
+    void run(const std::string &name, uint64_t ops, uint64_t instructions, const std::function<void(Stopwatch &)> &func)
+    {
+        if (!enabled(name)) {
+            return;
+        }
+
+        double total = 0;
+        uint64_t runs = 0;
+
+        // One untimed run first so caches and lazily built state are warm.
+        Stopwatch warmup;
+        func(warmup);
+
+        while (total < m_options.min_time || runs == 0) {
+            Stopwatch watch;
+            func(watch);
+            watch.pause();
+            total += watch.seconds();
+            ++runs;
+        }
+
+        double ns_per_op = total * 1e9 / double(runs * ops);
+        nlohmann::json result = {{"name", name},
+            {"runs", runs},
+            {"ops_per_run", ops},
+            {"ns_per_op", ns_per_op},
+            {"ops_per_sec", 1e9 / ns_per_op}};
+
+        if (instructions != 0) {
+            result["instructions_per_sec"] = double(runs * instructions) / total;
+        }
+
+        if (m_options.verbose) {
+            fprintf(stderr, "%-40s %12.1f ns/op %14.0f ops/s\n", name.c_str(), ns_per_op, 1e9 / ns_per_op);
+        }
+
+        m_results.push_back(result);
+    }
+
+    const nlohmann::json &results() const { return m_results; }
+
+private:
+    const Options &m_options;
+    nlohmann::json m_results;
+};
+
+/**
+ * Discards output so only producing it is measured.
+ */
+class NullSink : public unassemblize::OutputSink
+{
+protected:
+    void drain(const char *, size_t) override {}
+};
+
+void put_le32(std::vector<uint8_t> &out, uint32_t value)
+{
+    for (int i = 0; i < 4; ++i) {
+        out.push_back(uint8_t(value >> (i * 8)));
+    }
+}
+
+struct Corpus
+{
+    const char *name;
+    uint32_t start; // Offset in the code section.
+    uint32_t end; // Last byte.
+    size_t instructions;
+};
+
+/**
+ * Builds the code corpora, each routes nearly every operand through one formatter hook so the hooks can be compared
+ * against the register only baseline. Branches and pointers aim at a stub past the corpora and immediates and memory
+ * operands at the data section, so they get generated names the way unknown code and data would.
+ */
+std::vector<Corpus> build_corpora(unassemblize::SyntheticImage &image)
+{
+    enum
+    {
+        REGISTER,
+        BRANCH,
+        IMMEDIATE,
+        MEMORY,
+        STACK,
+        POINTER,
+        MIXED,
+        CORPUS_COUNT,
+    };
+
+    static const char *const names[CORPUS_COUNT] = {
+        "register", "branch", "immediate", "memory", "stack", "pointer", "mixed"};
+    // Upper bound on the size of each corpus so the branch targets are known before the code is written.
+    const uint32_t stub = uint32_t(CORPUS_COUNT * CORPUS_INSTRUCTIONS * 7);
+    uint32_t text_address = image.image_base + unassemblize::SyntheticImage::ALIGNMENT;
+    uint32_t data_address = text_address + unassemblize::SyntheticImage::page_align(stub + 1);
+    std::vector<uint8_t> &text = image.text;
+    std::vector<Corpus> corpora;
+
+    for (int kind = 0; kind < CORPUS_COUNT; ++kind) {
+        Corpus corpus = {names[kind], uint32_t(text.size()), 0, CORPUS_INSTRUCTIONS};
+
+        for (size_t i = 0; i < CORPUS_INSTRUCTIONS; ++i) {
+            uint32_t data = data_address + uint32_t(i % 1024) * 4;
+            int op = kind == MIXED ? int(i % (CORPUS_COUNT - 1)) : kind;
+
+            switch (op) {
+                case REGISTER: // mov eax, ebx
+                    text.insert(text.end(), {0x89, 0xd8});
+                    break;
+                case BRANCH: // call stub
+                    text.push_back(0xe8);
+                    put_le32(text, stub - uint32_t(text.size() + 4));
+                    break;
+                case IMMEDIATE: // push offset data
+                    text.push_back(0x68);
+                    put_le32(text, data);
+                    break;
+                case MEMORY: // mov ecx, [data]
+                    text.insert(text.end(), {0x8b, 0x0d});
+                    put_le32(text, data);
+                    break;
+                case STACK: // mov eax, [ebp+8]
+                    text.insert(text.end(), {0x8b, 0x45, 0x08});
+                    break;
+                case POINTER: // jmp far 0x8:stub
+                    text.push_back(0xea);
+                    put_le32(text, text_address + stub);
+                    text.insert(text.end(), {0x08, 0x00});
+                    break;
+            }
+        }
+
+        corpus.end = uint32_t(text.size() - 1);
+        corpora.push_back(corpus);
+    }
+
+    text.resize(stub);
+    text.push_back(0xc3); // ret
+    image.data.assign(4096, 0);
+
+    return corpora;
+}
+
+void add_symbols(unassemblize::Executable &exe, size_t count, uint64_t start)
+{
+    char name[32];
+
+    for (size_t i = 0; i < count; ++i) {
+        snprintf(name, sizeof(name), "sym_%zx", i);
+        exe.add_symbol(name, start + i * 16, 8);
+    }
+}
+
+void bench_disassembly(Runner &runner, const char *image_file, const std::vector<Corpus> &corpora)
+{
+    unassemblize::Executable exe(image_file);
+    uint64_t text = exe.section_address(".text");
+    NullSink sink;
+
+    for (int masm = 0; masm < 2; ++masm) {
+        unassemblize::FunctionSetup setup(
+            masm ? unassemblize::Function::FORMAT_MASM : unassemblize::Function::FORMAT_IGAS, exe.machine_mode());
+
+        for (const Corpus &corpus : corpora) {
+            std::string name = std::string("disassemble/") + (masm ? "masm/" : "igas/") + corpus.name;
+            runner.run(name, corpus.instructions, corpus.instructions, [&](Stopwatch &) {
+                unassemblize::Function func(exe, ".text", text + corpus.start, text + corpus.end);
+                func.disassemble(setup, sink);
+                sink.flush();
+            });
+        }
+    }
+}
+
+void bench_symbols(Runner &runner, const char *image_file)
+{
+    for (size_t count : SYMBOL_COUNTS) {
+        std::string suffix = "/" + std::to_string(count);
+
+        if (!runner.enabled("get_symbol" + suffix) && !runner.enabled("get_nearest_symbol" + suffix)) {
+            continue;
+        }
+
+        unassemblize::Executable exe(image_file);
+        uint64_t start = exe.section_address(".data");
+        add_symbols(exe, count, start);
+
+        // Half the lookups hit a symbol exactly, the rest land inside one.
+        std::vector<uint64_t> addresses(LOOKUPS_PER_RUN);
+        uint64_t state = 0x9e3779b97f4a7c15ull;
+
+        for (uint64_t &address : addresses) {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            address = start + (state % count) * 16 + ((state >> 32) & 1) * 4;
+        }
+
+        uint64_t sink = 0;
+        runner.run("get_symbol" + suffix, addresses.size(), 0, [&](Stopwatch &) {
+            for (uint64_t address : addresses) {
+                sink += exe.get_symbol(address).name;
+            }
+        });
+        runner.run("get_nearest_symbol" + suffix, addresses.size(), 0, [&](Stopwatch &) {
+            for (uint64_t address : addresses) {
+                sink += exe.get_nearest_symbol(address).name;
+            }
+        });
+
+        if (sink == 1) {
+            printf("\n"); // Keeps the lookups from being optimised away.
+        }
+    }
+}
+
+void bench_config(Runner &runner, const char *image_file, const std::filesystem::path &dir)
+{
+    for (size_t count : CONFIG_SYMBOL_COUNTS) {
+        for (const char *extension : {".json", ".db"}) {
+            std::string suffix = std::string(extension + 1) + "/" + std::to_string(count);
+            std::string config = (dir / ("config_" + std::to_string(count) + extension)).string();
+
+            if (!runner.enabled("save_config/" + suffix) && !runner.enabled("load_config/" + suffix)) {
+                continue;
+            }
+
+            unassemblize::Executable source(image_file);
+            add_symbols(source, count, source.section_address(".data"));
+
+            // Saving over an existing config only appends to its journal, so each run starts without one.
+            runner.run("save_config/" + suffix, count, 0, [&](Stopwatch &watch) {
+                watch.pause();
+                std::filesystem::remove(config);
+                watch.resume();
+                source.save_config(config.c_str());
+            });
+            runner.run("load_config/" + suffix, count, 0, [&](Stopwatch &watch) {
+                watch.pause();
+                unassemblize::Executable exe(image_file);
+                watch.resume();
+                exe.load_config(config.c_str());
+                watch.pause(); // Destroying the executable isn't part of loading.
+            });
+        }
+    }
+}
+
+void print_help()
+{
+    printf(
+        "\nunassemblize_bench\n"
+        "    Micro benchmarks for unassemblize\n\n"
+        "Usage:\n"
+        "  unassemblize_bench [OPTIONS]\n"
+        "Options:\n"
+        "  -o --output     File to write the JSON results to. Default is stdout.\n"
+        "  -f --filter     Only run benchmarks whose name contains the given text.\n"
+        "  -t --time       Minimum seconds to repeat each benchmark for. Default: 0.5\n"
+        "  -v --verbose    Print each result as it completes to stderr.\n"
+        "  -h --help       Displays this help.\n\n");
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+    const char *output = nullptr;
+    Options options = {nullptr, 0.5, false};
+
+    while (true) {
+        static struct option long_options[] = {
+            {"output", required_argument, nullptr, 'o'},
+            {"filter", required_argument, nullptr, 'f'},
+            {"time", required_argument, nullptr, 't'},
+            {"verbose", no_argument, nullptr, 'v'},
+            {"help", no_argument, nullptr, 'h'},
+            {nullptr, no_argument, nullptr, 0},
+        };
+
+        int option_index = 0;
+
+        int c = getopt_long(argc, argv, "+vh?o:f:t:", long_options, &option_index);
+
+        if (c == -1) {
+            break;
+        }
+
+        switch (c) {
+            case 'o':
+                output = optarg;
+                break;
+            case 'f':
+                options.filter = optarg;
+                break;
+            case 't':
+                options.min_time = strtod(optarg, nullptr);
+                break;
+            case 'v':
+                options.verbose = true;
+                break;
+            case '?':
+            case 'h':
+                print_help();
+                return 0;
+            default:
+                break;
+        }
+    }
+
+    // Inputs are generated into a scratch directory so every run measures the same bytes.
+    std::error_code ec;
+    std::filesystem::path dir = std::filesystem::temp_directory_path(ec) / "unassemblize_bench";
+    std::filesystem::create_directories(dir, ec);
+    std::string image_file = (dir / "corpus.elf").string();
+
+    unassemblize::SyntheticImage image = {IMAGE_BASE, {}, {}};
+    std::vector<Corpus> corpora = build_corpora(image);
+
+    if (!unassemblize::write_elf32(image_file.c_str(), image)) {
+        printf("Failed to write benchmark input '%s'.\n", image_file.c_str());
+        return -1;
+    }
+
+    Runner runner(options);
+    bench_disassembly(runner, image_file.c_str(), corpora);
+    bench_symbols(runner, image_file.c_str());
+    bench_config(runner, image_file.c_str(), dir);
+    std::filesystem::remove_all(dir, ec);
+
+    nlohmann::json js = {{"benchmarks", runner.results()}};
+    std::string text = js.dump(4);
+
+    if (output == nullptr) {
+        printf("%s\n", text.c_str());
+        return 0;
+    }
+
+    FILE *fp = fopen(output, "w");
+
+    if (fp == nullptr) {
+        printf("Failed to open '%s' for writing.\n", output);
+        return -1;
+    }
+
+    fprintf(fp, "%s\n", text.c_str());
+
+    return fclose(fp) == 0 ? 0 : -1;
+}
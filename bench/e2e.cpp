@@ -0,0 +1,340 @@
+/**
+ * @file
+ *
+ * @brief End to end throughput benchmark running the command line tool over generated binaries.
+ *
+ * @copyright Assemblize is free software: you can redistribute it and/or
+ *            modify it under the terms of the GNU General Public License
+ *            as published by the Free Software Foundation, either version
+ *            3 of the License, or (at your option) any later version.
+ *            A full copy of the GNU General Public License can be found in
+ *            LICENSE
+ */
+#include "synthimage.h"
+#include <chrono>
+#include <filesystem>
+#include <getopt.h>
+#include <inttypes.h>
+#include <nlohmann/json.hpp>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <strings.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+#ifndef UNASSEMBLIZE_CLI
+#define UNASSEMBLIZE_CLI "unassemblize"
+#endif
+
+namespace
+{
+struct RunResult
+{
+    bool ok;
+    double wall_seconds;
+    uint64_t peak_rss; // Bytes.
+    std::vector<std::pair<std::string, double>> phases; // From the tool's --timings output, in the order reported.
+};
+
+/**
+ * Runs the tool with its stderr piped back to collect the phase timings, the peak resident set size comes from the
+ * child's resource usage so it covers only the tool.
+ */
+RunResult run_tool(const std::vector<std::string> &args)
+{
+    RunResult result = {false, 0, 0, {}};
+    std::vector<char *> argv;
+
+    for (const std::string &arg : args) {
+        argv.push_back(const_cast<char *>(arg.c_str()));
+    }
+
+    argv.push_back(nullptr);
+    int fds[2];
+
+    if (pipe(fds) != 0) {
+        return result;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    pid_t pid = fork();
+
+    if (pid == 0) {
+        dup2(fds[1], STDERR_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        execv(argv[0], argv.data());
+        _exit(127);
+    }
+
+    close(fds[1]);
+
+    if (pid < 0) {
+        close(fds[0]);
+        return result;
+    }
+
+    std::string errors;
+    char buffer[4096];
+    ssize_t size;
+
+    while ((size = read(fds[0], buffer, sizeof(buffer))) > 0) {
+        errors.append(buffer, size);
+    }
+
+    close(fds[0]);
+    int status;
+    struct rusage usage;
+
+    if (wait4(pid, &status, 0, &usage) != pid) {
+        return result;
+    }
+
+    result.wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+#ifdef __APPLE__
+    result.peak_rss = usage.ru_maxrss;
+#else
+    result.peak_rss = uint64_t(usage.ru_maxrss) * 1024;
+#endif
+    result.ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+
+    // Anything that isn't a timing line is passed on so failures can be seen.
+    size_t pos = 0;
+
+    while (pos < errors.size()) {
+        size_t end = errors.find('\n', pos);
+        end = end == std::string::npos ? errors.size() : end;
+        std::string line = errors.substr(pos, end - pos);
+        char phase[64];
+        double seconds;
+
+        if (sscanf(line.c_str(), "timing %63s %lf", phase, &seconds) == 2) {
+            result.phases.emplace_back(phase, seconds);
+        } else if (!line.empty()) {
+            fprintf(stderr, "%s\n", line.c_str());
+        }
+
+        pos = end + 1;
+    }
+
+    return result;
+}
+
+std::vector<uint64_t> parse_sizes(const char *str)
+{
+    std::vector<uint64_t> sizes;
+
+    while (*str != '\0') {
+        char *end;
+        uint64_t size = strtoull(str, &end, 10);
+
+        if (end == str) {
+            break;
+        }
+
+        sizes.push_back(size);
+        str = *end == ',' ? end + 1 : end;
+    }
+
+    return sizes;
+}
+
+void print_help()
+{
+    printf(
+        "\nunassemblize_e2e\n"
+        "    End to end throughput benchmark for unassemblize\n\n"
+        "Usage:\n"
+        "  unassemblize_e2e [OPTIONS]\n"
+        "Options:\n"
+        "  -o --output     File to write the JSON results to. Default is stdout.\n"
+        "  -s --sizes      Comma separated input sizes in megabytes.\n"
+        "                  Default: 1,4,16,64,256,1024\n"
+        "  -f --format     Binary format to generate, elf or pe. Default: elf\n"
+        "  -j --jobs       Threads the tool uses, 0 for one per CPU. Default: 1\n"
+        "  -w --work       Directory for the generated inputs and the output, which\n"
+        "                  are removed after each size. Default: system temp dir\n"
+        "  --cli           Path to the unassemblize tool. Default: the one built\n"
+        "                  alongside this benchmark\n"
+        "  --tables        Every nth function switches through a jump table, 0 for\n"
+        "                  none. Default: 8\n"
+        "  --symbols       Symbols per megabyte of input, 0 for one per function.\n"
+        "                  Default: 0\n"
+        "  -v --verbose    Print each result as it completes to stderr.\n"
+        "  -h --help       Displays this help.\n\n");
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+    const char *output = nullptr;
+    const char *cli = UNASSEMBLIZE_CLI;
+    const char *work_dir = nullptr;
+    std::vector<uint64_t> sizes = {1, 4, 16, 64, 256, 1024};
+    unassemblize::ImageFormats format = unassemblize::IMAGE_ELF32;
+    unsigned jobs = 1;
+    uint32_t tables = 8;
+    uint64_t symbols_per_mb = 0;
+    bool verbose = false;
+
+    while (true) {
+        static struct option long_options[] = {
+            {"output", required_argument, nullptr, 'o'},
+            {"sizes", required_argument, nullptr, 's'},
+            {"format", required_argument, nullptr, 'f'},
+            {"jobs", required_argument, nullptr, 'j'},
+            {"work", required_argument, nullptr, 'w'},
+            {"cli", required_argument, nullptr, 1},
+            {"tables", required_argument, nullptr, 2},
+            {"symbols", required_argument, nullptr, 3},
+            {"verbose", no_argument, nullptr, 'v'},
+            {"help", no_argument, nullptr, 'h'},
+            {nullptr, no_argument, nullptr, 0},
+        };
+
+        int option_index = 0;
+
+        int c = getopt_long(argc, argv, "+vh?o:s:f:j:w:", long_options, &option_index);
+
+        if (c == -1) {
+            break;
+        }
+
+        switch (c) {
+            case 1:
+                cli = optarg;
+                break;
+            case 2:
+                tables = strtoul(optarg, nullptr, 10);
+                break;
+            case 3:
+                symbols_per_mb = strtoull(optarg, nullptr, 10);
+                break;
+            case 'o':
+                output = optarg;
+                break;
+            case 's':
+                sizes = parse_sizes(optarg);
+                break;
+            case 'f':
+                format = strcasecmp(optarg, "pe") == 0 ? unassemblize::IMAGE_PE32 : unassemblize::IMAGE_ELF32;
+                break;
+            case 'j':
+                jobs = strtoul(optarg, nullptr, 10);
+                break;
+            case 'w':
+                work_dir = optarg;
+                break;
+            case 'v':
+                verbose = true;
+                break;
+            case '?':
+            case 'h':
+                print_help();
+                return 0;
+            default:
+                break;
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::path dir = work_dir != nullptr ? std::filesystem::path(work_dir)
+                                                    : std::filesystem::temp_directory_path(ec) / "unassemblize_e2e";
+    std::filesystem::create_directories(dir, ec);
+    std::string image_file = (dir / (format == unassemblize::IMAGE_PE32 ? "input.exe" : "input.elf")).string();
+    std::string config_file = (dir / "config.json").string();
+    std::string output_file = (dir / "output.S").string();
+    nlohmann::json results = nlohmann::json::array();
+
+    for (uint64_t megabytes : sizes) {
+        // Four fifths code and one fifth data, the layout of a typical game executable.
+        uint64_t size = megabytes << 20;
+        unassemblize::ProgramOptions options = {size / 5 * 4, size / 5, 256, tables, 16, symbols_per_mb * megabytes, 1};
+        unassemblize::SyntheticImage image = {0x400000, {}, {}};
+        std::vector<unassemblize::SyntheticSymbol> symbols;
+
+        auto start = std::chrono::steady_clock::now();
+        unassemblize::generate_program(options, image, symbols);
+        bool written = unassemblize::write_image(image_file.c_str(), image, format)
+            && unassemblize::write_config(config_file.c_str(), symbols);
+        double generate_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        uint64_t input_size = std::filesystem::file_size(image_file, ec);
+        image = {};
+
+        if (!written) {
+            fprintf(stderr, "Failed to write the %" PRIu64 "MB input to '%s'.\n", megabytes, dir.string().c_str());
+            return -1;
+        }
+
+        RunResult run = run_tool({cli,
+            "--timings",
+            "-a",
+            "-j",
+            std::to_string(jobs),
+            "-c",
+            config_file,
+            "-o",
+            output_file,
+            image_file});
+
+        if (!run.ok) {
+            fprintf(stderr, "Running '%s' on the %" PRIu64 "MB input failed.\n", cli, megabytes);
+            return -1;
+        }
+
+        nlohmann::json phases = nlohmann::json::object();
+
+        for (const auto &phase : run.phases) {
+            phases[phase.first] = phase.second;
+        }
+
+        double mb_per_sec = double(input_size) / double(1 << 20) / run.wall_seconds;
+        results.push_back({{"size_mb", megabytes},
+            {"input_bytes", input_size},
+            {"output_bytes", std::filesystem::file_size(output_file, ec)},
+            {"symbols", symbols.size()},
+            {"generate_seconds", generate_seconds},
+            {"wall_seconds", run.wall_seconds},
+            {"mb_per_sec", mb_per_sec},
+            {"peak_rss_bytes", run.peak_rss},
+            {"phases", phases}});
+
+        if (verbose) {
+            fprintf(stderr,
+                "%6" PRIu64 " MB %10.3f s %10.2f MB/s %10.1f MB peak\n",
+                megabytes,
+                run.wall_seconds,
+                mb_per_sec,
+                double(run.peak_rss) / double(1 << 20));
+        }
+
+        std::filesystem::remove(image_file, ec);
+        std::filesystem::remove(config_file, ec);
+        std::filesystem::remove(output_file, ec);
+    }
+
+    std::string text = nlohmann::json({{"format", format == unassemblize::IMAGE_PE32 ? "pe" : "elf"},
+                                           {"jobs", jobs},
+                                           {"results", results}})
+                           .dump(4);
+
+    if (output == nullptr) {
+        printf("%s\n", text.c_str());
+        return 0;
+    }
+
+    FILE *fp = fopen(output, "w");
+
+    if (fp == nullptr) {
+        printf("Failed to open '%s' for writing.\n", output);
+        return -1;
+    }
+
+    fprintf(fp, "%s\n", text.c_str());
+
+    return fclose(fp) == 0 ? 0 : -1;
+}
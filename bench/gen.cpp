@@ -0,0 +1,165 @@
+/**
+ * @file
+ *
+ * @brief Generates synthetic binaries and matching configs for end to end benchmarks.
+ *
+ * @copyright Assemblize is free software: you can redistribute it and/or
+ *            modify it under the terms of the GNU General Public License
+ *            as published by the Free Software Foundation, either version
+ *            3 of the License, or (at your option) any later version.
+ *            A full copy of the GNU General Public License can be found in
+ *            LICENSE
+ */
+#include "synthimage.h"
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <strings.h>
+
+namespace
+{
+void print_help()
+{
+    printf(
+        "\nunassemblize_gen\n"
+        "    Synthetic binary generator for unassemblize benchmarks\n\n"
+        "Usage:\n"
+        "  unassemblize_gen [OPTIONS] OUTPUT\n"
+        "Options:\n"
+        "  -f --format     Binary format to write, elf or pe. Default: elf\n"
+        "  -c --config     Config file to write the program's symbols and sections to.\n"
+        "                  Default: config.json\n"
+        "  -s --size       Code section size in bytes, k, m and g suffixes are\n"
+        "                  accepted. Default: 1m\n"
+        "  -d --data       Data section size in bytes, with suffixes as --size.\n"
+        "                  Default: a quarter of the code size\n"
+        "  --funcsize      Average function size in bytes. Default: 256\n"
+        "  --tables        Every nth function switches through a jump table, 0 for\n"
+        "                  none. Default: 8\n"
+        "  --entries       Entries in each jump table, at most 127. Default: 16\n"
+        "  --symbols       Number of symbols in the config, spread over the functions\n"
+        "                  then naming data. Default: one per function\n"
+        "  --seed          Seed for the generator, the same seed and options always\n"
+        "                  give the same output. Default: 1\n"
+        "  -h --help       Displays this help.\n\n");
+}
+
+uint64_t parse_size(const char *str)
+{
+    char *end;
+    uint64_t size = strtoull(str, &end, 0);
+
+    switch (*end) {
+        case 'g':
+        case 'G':
+            return size << 30;
+        case 'm':
+        case 'M':
+            return size << 20;
+        case 'k':
+        case 'K':
+            return size << 10;
+        default:
+            return size;
+    }
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+    const char *config_file = "config.json";
+    unassemblize::ImageFormats format = unassemblize::IMAGE_ELF32;
+    unassemblize::ProgramOptions options = {1 << 20, UINT64_MAX, 256, 8, 16, 0, 1};
+
+    while (true) {
+        static struct option long_options[] = {
+            {"format", required_argument, nullptr, 'f'},
+            {"config", required_argument, nullptr, 'c'},
+            {"size", required_argument, nullptr, 's'},
+            {"data", required_argument, nullptr, 'd'},
+            {"funcsize", required_argument, nullptr, 1},
+            {"tables", required_argument, nullptr, 2},
+            {"entries", required_argument, nullptr, 3},
+            {"symbols", required_argument, nullptr, 4},
+            {"seed", required_argument, nullptr, 5},
+            {"help", no_argument, nullptr, 'h'},
+            {nullptr, no_argument, nullptr, 0},
+        };
+
+        int option_index = 0;
+
+        int c = getopt_long(argc, argv, "+h?f:c:s:d:", long_options, &option_index);
+
+        if (c == -1) {
+            break;
+        }
+
+        switch (c) {
+            case 1:
+                options.function_size = strtoul(optarg, nullptr, 10);
+                break;
+            case 2:
+                options.jump_table_interval = strtoul(optarg, nullptr, 10);
+                break;
+            case 3:
+                options.jump_table_entries = strtoul(optarg, nullptr, 10);
+                break;
+            case 4:
+                options.symbol_count = strtoull(optarg, nullptr, 10);
+                break;
+            case 5:
+                options.seed = strtoull(optarg, nullptr, 0);
+                break;
+            case 'f':
+                format = strcasecmp(optarg, "pe") == 0 ? unassemblize::IMAGE_PE32 : unassemblize::IMAGE_ELF32;
+                break;
+            case 'c':
+                config_file = optarg;
+                break;
+            case 's':
+                options.code_size = parse_size(optarg);
+                break;
+            case 'd':
+                options.data_size = parse_size(optarg);
+                break;
+            case '?':
+            case 'h':
+                print_help();
+                return 0;
+            default:
+                break;
+        }
+    }
+
+    if (optind >= argc) {
+        print_help();
+        return -1;
+    }
+
+    if (options.data_size == UINT64_MAX) {
+        options.data_size = options.code_size / 4;
+    }
+
+    // Both sections have to fit the 32 bit address space above the image base.
+    if (options.code_size + options.data_size > (uint64_t(3) << 30)) {
+        printf("Code and data together can be at most 3g.\n");
+        return -1;
+    }
+
+    unassemblize::SyntheticImage image = {0x400000, {}, {}};
+    std::vector<unassemblize::SyntheticSymbol> symbols;
+    unassemblize::generate_program(options, image, symbols);
+
+    if (!unassemblize::write_image(argv[optind], image, format)) {
+        printf("Failed to write '%s'.\n", argv[optind]);
+        return -1;
+    }
+
+    if (!unassemblize::write_config(config_file, symbols)) {
+        printf("Failed to write config file '%s'.\n", config_file);
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,507 @@
+/**
+ * @file
+ *
+ * @brief Synthetic executable images and programs for benchmarks.
+ *
+ * @copyright Assemblize is free software: you can redistribute it and/or
+ *            modify it under the terms of the GNU General Public License
+ *            as published by the Free Software Foundation, either version
+ *            3 of the License, or (at your option) any later version.
+ *            A full copy of the GNU General Public License can be found in
+ *            LICENSE
+ */
+#include "synthimage.h"
+#include <algorithm>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace
+{
+// Only the fields a loader or LIEF needs are filled in, everything is little endian like the hosts we run on.
+struct Elf32Header
+{
+    uint8_t ident[16];
+    uint16_t type;
+    uint16_t machine;
+    uint32_t version;
+    uint32_t entry;
+    uint32_t phoff;
+    uint32_t shoff;
+    uint32_t flags;
+    uint16_t ehsize;
+    uint16_t phentsize;
+    uint16_t phnum;
+    uint16_t shentsize;
+    uint16_t shnum;
+    uint16_t shstrndx;
+};
+
+struct Elf32ProgramHeader
+{
+    uint32_t type;
+    uint32_t offset;
+    uint32_t vaddr;
+    uint32_t paddr;
+    uint32_t filesz;
+    uint32_t memsz;
+    uint32_t flags;
+    uint32_t align;
+};
+
+struct Elf32SectionHeader
+{
+    uint32_t name;
+    uint32_t type;
+    uint32_t flags;
+    uint32_t addr;
+    uint32_t offset;
+    uint32_t size;
+    uint32_t link;
+    uint32_t info;
+    uint32_t addralign;
+    uint32_t entsize;
+};
+
+const uint16_t ET_EXEC = 2;
+const uint16_t EM_386 = 3;
+const uint32_t PT_LOAD = 1;
+const uint32_t PF_RWX = 7;
+const uint32_t SHT_PROGBITS = 1;
+const uint32_t SHT_STRTAB = 3;
+const uint32_t SHF_WRITE = 1;
+const uint32_t SHF_ALLOC = 2;
+const uint32_t SHF_EXECINSTR = 4;
+
+// Offsets of each name in the section name table.
+const char SECTION_NAMES[] = "\0.text\0.data\0.shstrtab";
+const uint32_t TEXT_NAME = 1;
+const uint32_t DATA_NAME = 7;
+const uint32_t SHSTRTAB_NAME = 13;
+
+struct PeFileHeader
+{
+    uint16_t machine;
+    uint16_t section_count;
+    uint32_t timestamp;
+    uint32_t symbol_table;
+    uint32_t symbol_count;
+    uint16_t optional_header_size;
+    uint16_t characteristics;
+};
+
+struct PeOptionalHeader
+{
+    uint16_t magic;
+    uint8_t linker_major;
+    uint8_t linker_minor;
+    uint32_t code_size;
+    uint32_t initialized_data_size;
+    uint32_t uninitialized_data_size;
+    uint32_t entry_point;
+    uint32_t code_base;
+    uint32_t data_base;
+    uint32_t image_base;
+    uint32_t section_alignment;
+    uint32_t file_alignment;
+    uint16_t os_major;
+    uint16_t os_minor;
+    uint16_t image_major;
+    uint16_t image_minor;
+    uint16_t subsystem_major;
+    uint16_t subsystem_minor;
+    uint32_t win32_version;
+    uint32_t image_size;
+    uint32_t headers_size;
+    uint32_t checksum;
+    uint16_t subsystem;
+    uint16_t dll_characteristics;
+    uint32_t stack_reserve;
+    uint32_t stack_commit;
+    uint32_t heap_reserve;
+    uint32_t heap_commit;
+    uint32_t loader_flags;
+    uint32_t directory_count;
+    uint32_t directories[16][2];
+};
+
+struct PeSectionHeader
+{
+    char name[8];
+    uint32_t virtual_size;
+    uint32_t virtual_address;
+    uint32_t raw_size;
+    uint32_t raw_offset;
+    uint32_t relocations;
+    uint32_t line_numbers;
+    uint16_t relocation_count;
+    uint16_t line_number_count;
+    uint32_t characteristics;
+};
+
+const uint32_t PE_HEADER_OFFSET = 0x40;
+const uint16_t IMAGE_FILE_MACHINE_I386 = 0x14c;
+const uint16_t IMAGE_FILE_EXECUTABLE_32BIT = 0x0102;
+const uint16_t IMAGE_SUBSYSTEM_WINDOWS_CUI = 3;
+const uint32_t IMAGE_SCN_TEXT = 0x60000020; // Code, execute and read.
+const uint32_t IMAGE_SCN_DATA = 0xc0000040; // Initialized data, read and write.
+
+/**
+ * Deterministic generator so the same options always give the same program.
+ */
+class Random
+{
+public:
+    explicit Random(uint64_t seed) : m_state(seed != 0 ? seed : 0x9e3779b97f4a7c15ull) {}
+
+    uint64_t next()
+    {
+        m_state ^= m_state << 13;
+        m_state ^= m_state >> 7;
+        m_state ^= m_state << 17;
+        return m_state;
+    }
+
+    uint32_t below(uint64_t limit) { return limit != 0 ? uint32_t(next() % limit) : 0; }
+
+private:
+    uint64_t m_state;
+};
+
+void put_le32(std::vector<uint8_t> &out, uint32_t value)
+{
+    for (int i = 0; i < 4; ++i) {
+        out.push_back(uint8_t(value >> (i * 8)));
+    }
+}
+
+void set_le32(std::vector<uint8_t> &out, size_t offset, uint32_t value)
+{
+    for (int i = 0; i < 4; ++i) {
+        out[offset + i] = uint8_t(value >> (i * 8));
+    }
+}
+
+/**
+ * Switch on the second argument, cmp/ja bound check then jmp through a table placed straight after it the way MSVC
+ * lays them out. Each case sets eax and jumps to the end, the default clears it.
+ */
+void add_switch(std::vector<uint8_t> &text, uint32_t text_address, uint32_t entries)
+{
+    const uint32_t case_size = 10;
+    text.insert(text.end(), {0x8b, 0x45, 0x0c}); // mov eax, [ebp+12]
+    text.insert(text.end(), {0x83, 0xf8, uint8_t(entries - 1)}); // cmp eax, entries - 1
+    text.insert(text.end(), {0x0f, 0x87}); // ja default
+    size_t ja = text.size();
+    put_le32(text, 0);
+    text.insert(text.end(), {0xff, 0x24, 0x85}); // jmp [eax*4+table]
+    uint32_t table = uint32_t(text.size()) + 4;
+    put_le32(text, text_address + table);
+    uint32_t cases = table + entries * 4;
+    uint32_t default_case = cases + entries * case_size;
+    uint32_t end = default_case + 2;
+
+    for (uint32_t i = 0; i < entries; ++i) {
+        put_le32(text, text_address + cases + i * case_size);
+    }
+
+    for (uint32_t i = 0; i < entries; ++i) {
+        text.push_back(0xb8); // mov eax, i
+        put_le32(text, i);
+        text.push_back(0xe9); // jmp end
+        put_le32(text, end - uint32_t(text.size() + 4));
+    }
+
+    set_le32(text, ja, default_case - uint32_t(ja + 4));
+    text.insert(text.end(), {0x31, 0xc0}); // xor eax, eax
+}
+
+bool write_padding(FILE *fp, long offset)
+{
+    static const uint8_t zeros[256] = {};
+
+    for (long pos = ftell(fp); pos < offset; pos += sizeof(zeros)) {
+        size_t count = offset - pos < long(sizeof(zeros)) ? offset - pos : sizeof(zeros);
+
+        if (fwrite(zeros, 1, count, fp) != count) {
+            return false;
+        }
+    }
+
+    return true;
+}
+} // namespace
+
+bool unassemblize::write_elf32(const char *file_name, const SyntheticImage &image)
+{
+    // File offsets match the offsets from the image base so the whole file maps as one segment.
+    uint32_t text_offset = SyntheticImage::ALIGNMENT;
+    uint32_t data_offset = image.data_address() - image.image_base;
+    uint32_t names_offset = data_offset + uint32_t(image.data.size());
+    uint32_t headers_offset = (names_offset + sizeof(SECTION_NAMES) + 3) & ~3u;
+
+    Elf32Header header = {};
+    memcpy(header.ident, "\x7f" "ELF", 4);
+    header.ident[4] = 1; // 32 bit.
+    header.ident[5] = 1; // Little endian.
+    header.ident[6] = 1; // Current version.
+    header.type = ET_EXEC;
+    header.machine = EM_386;
+    header.version = 1;
+    header.entry = image.text_address();
+    header.phoff = sizeof(Elf32Header);
+    header.shoff = headers_offset;
+    header.ehsize = sizeof(Elf32Header);
+    header.phentsize = sizeof(Elf32ProgramHeader);
+    header.phnum = 1;
+    header.shentsize = sizeof(Elf32SectionHeader);
+    header.shnum = 4;
+    header.shstrndx = 3;
+
+    Elf32ProgramHeader segment = {};
+    segment.type = PT_LOAD;
+    segment.offset = 0;
+    segment.vaddr = image.image_base;
+    segment.paddr = image.image_base;
+    segment.filesz = names_offset;
+    segment.memsz = names_offset;
+    segment.flags = PF_RWX;
+    segment.align = SyntheticImage::ALIGNMENT;
+
+    Elf32SectionHeader sections[4] = {};
+    sections[1] = {TEXT_NAME, SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, image.text_address(), text_offset,
+        uint32_t(image.text.size()), 0, 0, 16, 0};
+    sections[2] = {DATA_NAME, SHT_PROGBITS, SHF_ALLOC | SHF_WRITE, image.data_address(), data_offset,
+        uint32_t(image.data.size()), 0, 0, 16, 0};
+    sections[3] = {SHSTRTAB_NAME, SHT_STRTAB, 0, 0, names_offset, sizeof(SECTION_NAMES), 0, 0, 1, 0};
+
+    FILE *fp = fopen(file_name, "wb");
+
+    if (fp == nullptr) {
+        return false;
+    }
+
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+    ok = ok && fwrite(&segment, sizeof(segment), 1, fp) == 1;
+    ok = ok && write_padding(fp, text_offset);
+    ok = ok && (image.text.empty() || fwrite(image.text.data(), image.text.size(), 1, fp) == 1);
+    ok = ok && write_padding(fp, data_offset);
+    ok = ok && (image.data.empty() || fwrite(image.data.data(), image.data.size(), 1, fp) == 1);
+    ok = ok && fwrite(SECTION_NAMES, sizeof(SECTION_NAMES), 1, fp) == 1;
+    ok = ok && write_padding(fp, headers_offset);
+    ok = ok && fwrite(sections, sizeof(sections), 1, fp) == 1;
+    ok = fclose(fp) == 0 && ok;
+
+    return ok;
+}
+
+bool unassemblize::write_pe32(const char *file_name, const SyntheticImage &image)
+{
+    // File alignment matches the section alignment so file offsets are the same as RVAs.
+    uint32_t text_rva = SyntheticImage::ALIGNMENT;
+    uint32_t data_rva = image.data_address() - image.image_base;
+    uint32_t text_raw_size = SyntheticImage::page_align(image.text.size());
+    uint32_t data_raw_size = SyntheticImage::page_align(image.data.size());
+
+    uint8_t dos_header[PE_HEADER_OFFSET] = {'M', 'Z'};
+    memcpy(dos_header + 0x3c, &PE_HEADER_OFFSET, sizeof(PE_HEADER_OFFSET));
+
+    PeFileHeader header = {};
+    header.machine = IMAGE_FILE_MACHINE_I386;
+    header.section_count = 2;
+    header.optional_header_size = sizeof(PeOptionalHeader);
+    header.characteristics = IMAGE_FILE_EXECUTABLE_32BIT;
+
+    PeOptionalHeader optional = {};
+    optional.magic = 0x10b;
+    optional.code_size = text_raw_size;
+    optional.initialized_data_size = data_raw_size;
+    optional.entry_point = text_rva;
+    optional.code_base = text_rva;
+    optional.data_base = data_rva;
+    optional.image_base = image.image_base;
+    optional.section_alignment = SyntheticImage::ALIGNMENT;
+    optional.file_alignment = SyntheticImage::ALIGNMENT;
+    optional.os_major = 4;
+    optional.subsystem_major = 4;
+    optional.image_size = data_rva + data_raw_size;
+    optional.headers_size = SyntheticImage::ALIGNMENT;
+    optional.subsystem = IMAGE_SUBSYSTEM_WINDOWS_CUI;
+    optional.stack_reserve = 0x100000;
+    optional.stack_commit = 0x1000;
+    optional.heap_reserve = 0x100000;
+    optional.heap_commit = 0x1000;
+    optional.directory_count = 16;
+
+    PeSectionHeader sections[2] = {};
+    memcpy(sections[0].name, ".text", 5);
+    sections[0].virtual_size = uint32_t(image.text.size());
+    sections[0].virtual_address = text_rva;
+    sections[0].raw_size = text_raw_size;
+    sections[0].raw_offset = text_rva;
+    sections[0].characteristics = IMAGE_SCN_TEXT;
+    memcpy(sections[1].name, ".data", 5);
+    sections[1].virtual_size = uint32_t(image.data.size());
+    sections[1].virtual_address = data_rva;
+    sections[1].raw_size = data_raw_size;
+    sections[1].raw_offset = data_rva;
+    sections[1].characteristics = IMAGE_SCN_DATA;
+
+    FILE *fp = fopen(file_name, "wb");
+
+    if (fp == nullptr) {
+        return false;
+    }
+
+    bool ok = fwrite(dos_header, sizeof(dos_header), 1, fp) == 1;
+    ok = ok && fwrite("PE\0\0", 4, 1, fp) == 1;
+    ok = ok && fwrite(&header, sizeof(header), 1, fp) == 1;
+    ok = ok && fwrite(&optional, sizeof(optional), 1, fp) == 1;
+    ok = ok && fwrite(sections, sizeof(sections), 1, fp) == 1;
+    ok = ok && write_padding(fp, text_rva);
+    ok = ok && (image.text.empty() || fwrite(image.text.data(), image.text.size(), 1, fp) == 1);
+    ok = ok && write_padding(fp, data_rva);
+    ok = ok && (image.data.empty() || fwrite(image.data.data(), image.data.size(), 1, fp) == 1);
+    ok = ok && write_padding(fp, data_rva + data_raw_size);
+    ok = fclose(fp) == 0 && ok;
+
+    return ok;
+}
+
+bool unassemblize::write_image(const char *file_name, const SyntheticImage &image, ImageFormats format)
+{
+    return format == IMAGE_PE32 ? write_pe32(file_name, image) : write_elf32(file_name, image);
+}
+
+void unassemblize::generate_program(
+    const ProgramOptions &options, SyntheticImage &image, std::vector<SyntheticSymbol> &symbols)
+{
+    Random random(options.seed);
+    std::vector<uint8_t> &text = image.text;
+    uint32_t function_size = std::max<uint32_t>(options.function_size, 16);
+    uint32_t table_entries = std::min<uint32_t>(std::max<uint32_t>(options.jump_table_entries, 2), 127);
+    // The data section goes after the code, so its address is fixed by the size the code is generated up to.
+    uint32_t max_function = function_size * 2 + 32 + (options.jump_table_interval != 0 ? table_entries * 14 + 32 : 0);
+    uint32_t text_address = image.text_address();
+    uint32_t data_address = text_address + SyntheticImage::page_align(options.code_size + max_function);
+    uint32_t data_words = uint32_t(options.data_size / 4);
+    std::vector<uint32_t> starts;
+
+    text.clear();
+    text.reserve(data_address - text_address);
+    symbols.clear();
+
+    while (text.size() < options.code_size) {
+        uint32_t start = uint32_t(text.size());
+        uint32_t body_size = function_size / 2 + random.below(function_size);
+        bool has_switch = options.jump_table_interval != 0
+            && starts.size() % options.jump_table_interval == options.jump_table_interval - 1;
+
+        text.insert(text.end(), {0x55, 0x89, 0xe5}); // push ebp, mov ebp, esp
+
+        while (text.size() - start < body_size) {
+            uint32_t data = data_address + random.below(data_words) * 4;
+
+            switch (random.below(6)) {
+                case 0: // mov eax, [ebp+8]
+                    text.insert(text.end(), {0x8b, 0x45, 0x08});
+                    break;
+                case 1: // mov ecx, [data]
+                    text.insert(text.end(), {0x8b, 0x0d});
+                    put_le32(text, data);
+                    break;
+                case 2: // push offset data, add esp, 4
+                    text.push_back(0x68);
+                    put_le32(text, data);
+                    text.insert(text.end(), {0x83, 0xc4, 0x04});
+                    break;
+                case 3: { // call an earlier function, or this one for the first
+                    uint32_t target = starts.empty() ? start : starts[random.below(starts.size())];
+                    text.push_back(0xe8);
+                    put_le32(text, target - uint32_t(text.size() + 4));
+                    break;
+                }
+                case 4: // test eax, eax, jz over mov eax, ebx
+                    text.insert(text.end(), {0x85, 0xc0, 0x74, 0x02, 0x89, 0xd8});
+                    break;
+                default: // add eax, ecx
+                    text.insert(text.end(), {0x01, 0xc8});
+                    break;
+            }
+        }
+
+        if (has_switch) {
+            add_switch(text, text_address, table_entries);
+        }
+
+        text.insert(text.end(), {0x5d, 0xc3}); // pop ebp, ret
+        starts.push_back(start);
+        symbols.push_back({text_address + start, text.size() - start, uint32_t(starts.size() - 1), true});
+
+        while (text.size() % 16 != 0) {
+            text.push_back(0xcc);
+        }
+    }
+
+    // Sections are padded to the address the code was generated against.
+    text.resize(data_address - text_address, 0xcc);
+    image.data.assign(options.data_size, 0);
+
+    for (uint32_t i = 0; i < data_words; ++i) {
+        uint32_t value = random.below(4) == 0 ? text_address + starts[random.below(starts.size())] : uint32_t(random.next());
+        memcpy(image.data.data() + i * 4, &value, sizeof(value));
+    }
+
+    // Keep every nth function symbol to get the requested count, names stay those of the full set.
+    uint64_t symbol_count = options.symbol_count != 0 ? options.symbol_count : symbols.size();
+
+    if (symbol_count < symbols.size()) {
+        std::vector<SyntheticSymbol> kept;
+        kept.reserve(symbol_count);
+
+        for (uint64_t i = 0; i < symbol_count; ++i) {
+            kept.push_back(symbols[i * symbols.size() / symbol_count]);
+        }
+
+        symbols.swap(kept);
+    } else if (symbol_count > symbols.size() && data_words != 0) {
+        uint64_t count = std::min<uint64_t>(symbol_count - symbols.size(), data_words);
+        uint64_t stride = data_words / count * 4;
+
+        for (uint64_t i = 0; i < count; ++i) {
+            symbols.push_back({data_address + i * stride, 4, uint32_t(i), false});
+        }
+    }
+}
+
+bool unassemblize::write_config(const char *file_name, const std::vector<SyntheticSymbol> &symbols)
+{
+    // Written directly rather than through a JSON document since configs for the largest images hold millions of
+    // symbols.
+    FILE *fp = fopen(file_name, "w");
+
+    if (fp == nullptr) {
+        return false;
+    }
+
+    fprintf(fp,
+        "{\n"
+        "    \"config\": {\"codealign\": 16, \"dataalign\": 4, \"codepadding\": 204, \"datapadding\": 0},\n"
+        "    \"sections\": [{\"name\": \".text\", \"type\": \"code\"}, {\"name\": \".data\", \"type\": \"data\"}],\n"
+        "    \"symbols\": [");
+
+    for (size_t i = 0; i < symbols.size(); ++i) {
+        const SyntheticSymbol &sym = symbols[i];
+        fprintf(fp,
+            "%s\n        {\"name\": \"%s_%u\", \"address\": %" PRIu64 ", \"size\": %" PRIu64 "}",
+            i != 0 ? "," : "",
+            sym.code ? "func" : "data",
+            sym.index,
+            sym.address,
+            sym.size);
+    }
+
+    fprintf(fp, "\n    ]\n}\n");
+
+    return fclose(fp) == 0;
+}
@@ -0,0 +1,83 @@
+/**
+ * @file
+ *
+ * @brief Synthetic executable images and programs for benchmarks.
+ *
+ * @copyright Assemblize is free software: you can redistribute it and/or
+ *            modify it under the terms of the GNU General Public License
+ *            as published by the Free Software Foundation, either version
+ *            3 of the License, or (at your option) any later version.
+ *            A full copy of the GNU General Public License can be found in
+ *            LICENSE
+ */
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+namespace unassemblize
+{
+enum ImageFormats
+{
+    IMAGE_ELF32,
+    IMAGE_PE32,
+};
+
+/**
+ * Contents of a synthetic image. The code section is placed at the first page after the image base, the data section
+ * at the page after the code and the entry point is the start of the code section.
+ */
+struct SyntheticImage
+{
+    uint32_t image_base;
+    std::vector<uint8_t> text;
+    std::vector<uint8_t> data;
+
+    uint32_t text_address() const { return image_base + ALIGNMENT; }
+    uint32_t data_address() const { return text_address() + page_align(text.size()); }
+    static uint32_t page_align(uint64_t size) { return uint32_t((size + ALIGNMENT - 1) & ~uint64_t(ALIGNMENT - 1)); }
+
+    static const uint32_t ALIGNMENT = 0x1000;
+};
+
+/**
+ * Shape of a generated program. Functions are a frame setup, a body of common instructions referencing the stack,
+ * the data section and earlier functions, optionally a switch through a jump table, then a return.
+ */
+struct ProgramOptions
+{
+    uint64_t code_size; // Functions are generated until the code section reaches this size.
+    uint64_t data_size;
+    uint32_t function_size; // Average, individual functions vary from half to one and a half times this.
+    uint32_t jump_table_interval; // Every nth function has a switch, 0 for none.
+    uint32_t jump_table_entries; // At most 127.
+    uint64_t symbol_count; // Spread over the functions, any more than there are name data. 0 for one per function.
+    uint64_t seed;
+};
+
+struct SyntheticSymbol
+{
+    uint64_t address;
+    uint64_t size;
+    uint32_t index; // Names are func_<index> or data_<index>.
+    bool code;
+};
+
+/**
+ * Fills the image's sections with a generated program and returns its symbols sorted by address.
+ */
+void generate_program(const ProgramOptions &options, SyntheticImage &image, std::vector<SyntheticSymbol> &symbols);
+/**
+ * Writes the image as an i386 ELF executable with .text and .data sections in one loadable segment.
+ */
+bool write_elf32(const char *file_name, const SyntheticImage &image);
+/**
+ * Writes the image as a PE32 console executable with .text and .data sections and no imports.
+ */
+bool write_pe32(const char *file_name, const SyntheticImage &image);
+bool write_image(const char *file_name, const SyntheticImage &image, ImageFormats format);
+/**
+ * Writes a config.json for a generated program with its symbols and section types.
+ */
+bool write_config(const char *file_name, const std::vector<SyntheticSymbol> &symbols);
+} // namespace unassemblize
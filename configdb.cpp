@@ -0,0 +1,372 @@
+/**
+ * @file
+ *
+ * @brief Binary form of the config file for large symbol sets.
+ *
+ * @copyright Assemblize is free software: you can redistribute it and/or
+ *            modify it under the terms of the GNU General Public License
+ *            as published by the Free Software Foundation, either version
+ *            3 of the License, or (at your option) any later version.
+ *            A full copy of the GNU General Public License can be found in
+ *            LICENSE
+ */
+#include "configdb.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <nlohmann/json.hpp>
+#include <string.h>
+
+namespace
+{
+// Layout is the header then the symbol, section, object and object section tables followed by the string blob.
+// Everything is in native byte order and every table starts 8 byte aligned.
+const uint32_t DATABASE_VERSION = 1;
+
+struct DatabaseHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint32_t code_align;
+    uint32_t data_align;
+    uint8_t code_pad;
+    uint8_t data_pad;
+    uint8_t reserved[6];
+    uint64_t symbol_count;
+    uint64_t section_count;
+    uint64_t object_count;
+    uint64_t object_section_count;
+    uint64_t string_size;
+};
+
+template<typename T> bool write_table(FILE *fp, const T *table, size_t count)
+{
+    return count == 0 || fwrite(table, sizeof(T), count, fp) == count;
+}
+} // namespace
+
+const char unassemblize::ConfigDatabase::s_magic[] = "UNASMDB";
+
+unassemblize::ConfigDatabase::ConfigDatabase() : m_flags(0), m_config({sizeof(uint32_t), sizeof(uint32_t), 0x90, 0x00})
+{
+    update_views();
+}
+
+bool unassemblize::ConfigDatabase::is_database(const char *file_name)
+{
+    return std::filesystem::path(file_name).extension() == ".db";
+}
+
+bool unassemblize::ConfigDatabase::load(const char *file_name)
+{
+    close();
+
+    if (!m_file.open(file_name) || m_file.size() < sizeof(DatabaseHeader)) {
+        close();
+        return false;
+    }
+
+    DatabaseHeader header;
+    memcpy(&header, m_file.data(), sizeof(header));
+    uint64_t file_size = m_file.size();
+
+    if (memcmp(header.magic, s_magic, sizeof(header.magic)) != 0 || header.version != DATABASE_VERSION
+        || header.symbol_count > file_size || header.section_count > file_size || header.object_count > file_size
+        || header.object_section_count > file_size || header.string_size > file_size) {
+        close();
+        return false;
+    }
+
+    uint64_t tables_size = header.symbol_count * sizeof(Symbol) + header.section_count * sizeof(Section)
+        + header.object_count * sizeof(Object) + header.object_section_count * sizeof(ObjectSection);
+    const uint8_t *data = m_file.data() + sizeof(header);
+
+    if (file_size != sizeof(header) + tables_size + header.string_size
+        || (header.string_size != 0 && data[tables_size + header.string_size - 1] != '\0')) {
+        close();
+        return false;
+    }
+
+    m_flags = header.flags;
+    m_config = {header.code_align, header.data_align, header.code_pad, header.data_pad};
+    m_symbols = reinterpret_cast<const Symbol *>(data);
+    m_symbolCount = header.symbol_count;
+    m_sections = reinterpret_cast<const Section *>(m_symbols + m_symbolCount);
+    m_sectionCount = header.section_count;
+    m_objects = reinterpret_cast<const Object *>(m_sections + m_sectionCount);
+    m_objectCount = header.object_count;
+    m_objectSections = reinterpret_cast<const ObjectSection *>(m_objects + m_objectCount);
+    m_objectSectionCount = header.object_section_count;
+    m_strings = reinterpret_cast<const char *>(data + tables_size);
+    m_stringSize = header.string_size;
+
+    // Check every reference once here so readers can trust the tables.
+    bool valid = true;
+
+    for (size_t i = 0; i < m_symbolCount; ++i) {
+        valid = valid && m_symbols[i].name < header.string_size;
+    }
+
+    for (size_t i = 0; i < m_sectionCount; ++i) {
+        valid = valid && m_sections[i].name < header.string_size && m_sections[i].type < header.string_size;
+    }
+
+    for (size_t i = 0; i < m_objectCount; ++i) {
+        valid = valid && m_objects[i].name < header.string_size
+            && uint64_t(m_objects[i].first_section) + m_objects[i].section_count <= m_objectSectionCount;
+    }
+
+    for (size_t i = 0; i < m_objectSectionCount; ++i) {
+        valid = valid && m_objectSections[i].name < header.string_size;
+    }
+
+    if (!valid) {
+        close();
+    }
+
+    return valid;
+}
+
+bool unassemblize::ConfigDatabase::save(const char *file_name) const
+{
+    // Stable so symbols sharing an address keep their order.
+    std::vector<Symbol> symbols(m_symbols, m_symbols + m_symbolCount);
+    std::stable_sort(
+        symbols.begin(), symbols.end(), [](const Symbol &a, const Symbol &b) { return a.address < b.address; });
+
+    DatabaseHeader header = {};
+    memcpy(header.magic, s_magic, sizeof(header.magic));
+    header.version = DATABASE_VERSION;
+    header.flags = m_flags;
+    header.code_align = m_config.code_align;
+    header.data_align = m_config.data_align;
+    header.code_pad = m_config.code_pad;
+    header.data_pad = m_config.data_pad;
+    header.symbol_count = m_symbolCount;
+    header.section_count = m_sectionCount;
+    header.object_count = m_objectCount;
+    header.object_section_count = m_objectSectionCount;
+    header.string_size = m_stringSize;
+
+    // Written under a temporary name and renamed so a failed save never loses the old database.
+    std::error_code ec;
+    std::filesystem::path path(file_name);
+    std::filesystem::path temp_path = path;
+    temp_path += ".tmp";
+    FILE *fp = fopen(temp_path.string().c_str(), "wb");
+
+    if (fp == nullptr) {
+        return false;
+    }
+
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+    ok = ok && write_table(fp, symbols.data(), symbols.size());
+    ok = ok && write_table(fp, m_sections, m_sectionCount);
+    ok = ok && write_table(fp, m_objects, m_objectCount);
+    ok = ok && write_table(fp, m_objectSections, m_objectSectionCount);
+    ok = ok && fwrite(m_strings, 1, header.string_size, fp) == header.string_size;
+    ok = fclose(fp) == 0 && ok;
+
+    if (ok) {
+        std::filesystem::rename(temp_path, path, ec);
+        ok = !ec;
+    }
+
+    if (!ok) {
+        std::filesystem::remove(temp_path, ec);
+    }
+
+    return ok;
+}
+
+bool unassemblize::ConfigDatabase::load_json(const char *file_name)
+{
+    std::ifstream fs(file_name);
+
+    if (!fs.good()) {
+        return false;
+    }
+
+    from_json(nlohmann::json::parse(fs));
+
+    return true;
+}
+
+bool unassemblize::ConfigDatabase::save_json(const char *file_name) const
+{
+    nlohmann::json j;
+    to_json(j);
+    std::ofstream fs(file_name);
+    fs << std::setw(4) << j << std::endl;
+
+    return fs.good();
+}
+
+void unassemblize::ConfigDatabase::from_json(const nlohmann::json &js)
+{
+    auto conf = js.find("config");
+
+    if (conf != js.end()) {
+        Config config;
+        conf->at("codealign").get_to(config.code_align);
+        conf->at("dataalign").get_to(config.data_align);
+        conf->at("codepadding").get_to(config.code_pad);
+        conf->at("datapadding").get_to(config.data_pad);
+        set_config(config);
+    }
+
+    auto symbols = js.find("symbols");
+
+    if (symbols != js.end()) {
+        set_flags(HAS_SYMBOLS);
+        m_symbolTable.reserve(symbols->size());
+
+        for (auto it = symbols->begin(); it != symbols->end(); ++it) {
+            add_symbol(it->at("name").get<std::string>(), it->at("address").get<uint64_t>(), it->at("size").get<uint64_t>());
+        }
+    }
+
+    auto sections = js.find("sections");
+
+    if (sections != js.end()) {
+        set_flags(HAS_SECTIONS);
+
+        for (auto it = sections->begin(); it != sections->end(); ++it) {
+            add_section(it->at("name").get<std::string>(), it->at("type").get<std::string>());
+        }
+    }
+
+    auto objects = js.find("objects");
+
+    if (objects != js.end()) {
+        set_flags(HAS_OBJECTS);
+
+        for (auto it = objects->begin(); it != objects->end(); ++it) {
+            add_object(it->at("name").get<std::string>());
+            auto &obj_sections = it->at("sections");
+
+            for (auto sec = obj_sections.begin(); sec != obj_sections.end(); ++sec) {
+                add_object_section(
+                    sec->at("name").get<std::string>(), sec->at("start").get<uint64_t>(), sec->at("size").get<uint64_t>());
+            }
+        }
+    }
+}
+
+void unassemblize::ConfigDatabase::to_json(nlohmann::json &js) const
+{
+    if (m_flags & HAS_CONFIG) {
+        nlohmann::json &conf = js["config"];
+        conf["codealign"] = m_config.code_align;
+        conf["dataalign"] = m_config.data_align;
+        conf["codepadding"] = m_config.code_pad;
+        conf["datapadding"] = m_config.data_pad;
+    }
+
+    if (m_flags & HAS_SYMBOLS) {
+        nlohmann::json &symbols = js["symbols"];
+
+        for (size_t i = 0; i < m_symbolCount; ++i) {
+            const Symbol &sym = m_symbols[i];
+            symbols.push_back({{"name", string(sym.name)}, {"address", sym.address}, {"size", sym.size}});
+        }
+    }
+
+    if (m_flags & HAS_SECTIONS) {
+        nlohmann::json &sections = js["sections"];
+
+        for (size_t i = 0; i < m_sectionCount; ++i) {
+            sections.push_back({{"name", string(m_sections[i].name)}, {"type", string(m_sections[i].type)}});
+        }
+    }
+
+    if (m_flags & HAS_OBJECTS) {
+        nlohmann::json &objects = js["objects"];
+
+        for (size_t i = 0; i < m_objectCount; ++i) {
+            const Object &obj = m_objects[i];
+            objects.push_back({{"name", string(obj.name)}, {"sections", nlohmann::json()}});
+            auto &sections = objects.back().at("sections");
+
+            for (uint32_t j = 0; j < obj.section_count; ++j) {
+                const ObjectSection &sec = m_objectSections[obj.first_section + j];
+                sections.push_back({{"name", string(sec.name)}, {"start", sec.start}, {"size", sec.size}});
+            }
+        }
+    }
+}
+
+void unassemblize::ConfigDatabase::close()
+{
+    m_file.close();
+    m_flags = 0;
+    m_stringBlob.clear();
+    m_stringOffsets.clear();
+    m_symbolTable.clear();
+    m_sectionTable.clear();
+    m_objectTable.clear();
+    m_objectSectionTable.clear();
+    update_views();
+}
+
+void unassemblize::ConfigDatabase::set_config(const Config &config)
+{
+    m_config = config;
+    m_flags |= HAS_CONFIG;
+}
+
+void unassemblize::ConfigDatabase::add_symbol(const std::string &name, uint64_t address, uint64_t size)
+{
+    m_symbolTable.push_back({address, size, add_string(name), 0});
+    update_views();
+}
+
+void unassemblize::ConfigDatabase::add_section(const std::string &name, const std::string &type)
+{
+    m_sectionTable.push_back({add_string(name), add_string(type)});
+    update_views();
+}
+
+void unassemblize::ConfigDatabase::add_object(const std::string &name)
+{
+    m_objectTable.push_back({add_string(name), static_cast<uint32_t>(m_objectSectionTable.size()), 0, 0});
+    update_views();
+}
+
+void unassemblize::ConfigDatabase::add_object_section(const std::string &name, uint64_t start, uint64_t size)
+{
+    m_objectSectionTable.push_back({start, size, add_string(name), 0});
+    ++m_objectTable.back().section_count;
+    update_views();
+}
+
+uint32_t unassemblize::ConfigDatabase::add_string(const std::string &str)
+{
+    auto it = m_stringOffsets.find(str);
+
+    if (it != m_stringOffsets.end()) {
+        return it->second;
+    }
+
+    uint32_t offset = static_cast<uint32_t>(m_stringBlob.size());
+    m_stringBlob.append(str.c_str(), str.size() + 1);
+    m_stringOffsets.emplace(str, offset);
+
+    return offset;
+}
+
+void unassemblize::ConfigDatabase::update_views()
+{
+    m_strings = m_stringBlob.c_str();
+    m_stringSize = m_stringBlob.size();
+    m_symbols = m_symbolTable.data();
+    m_symbolCount = m_symbolTable.size();
+    m_sections = m_sectionTable.data();
+    m_sectionCount = m_sectionTable.size();
+    m_objects = m_objectTable.data();
+    m_objectCount = m_objectTable.size();
+    m_objectSections = m_objectSectionTable.data();
+    m_objectSectionCount = m_objectSectionTable.size();
+}
@@ -0,0 +1,144 @@
+/**
+ * @file
+ *
+ * @brief Binary form of the config file for large symbol sets.
+ *
+ * @copyright Assemblize is free software: you can redistribute it and/or
+ *            modify it under the terms of the GNU General Public License
+ *            as published by the Free Software Foundation, either version
+ *            3 of the License, or (at your option) any later version.
+ *            A full copy of the GNU General Public License can be found in
+ *            LICENSE
+ */
+#pragma once
+
+#include "mappedfile.h"
+#include <nlohmann/json_fwd.hpp>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace unassemblize
+{
+/**
+ * Holds the same information as config.json as flat tables with names in one string blob, so a loaded database is
+ * used straight from the mapped file. A database is either loaded, then read only, or built up with the add
+ * functions and saved. Conversion to and from the JSON layout keeps everything the JSON holds, though symbols come
+ * back sorted by address.
+ */
+class ConfigDatabase
+{
+public:
+    enum ContentFlags
+    {
+        HAS_CONFIG = 1 << 0,
+        HAS_SYMBOLS = 1 << 1,
+        HAS_SECTIONS = 1 << 2,
+        HAS_OBJECTS = 1 << 3,
+    };
+
+    // Names are offsets into the string blob.
+    struct Symbol
+    {
+        uint64_t address;
+        uint64_t size;
+        uint32_t name;
+        uint32_t reserved;
+    };
+
+    struct Section
+    {
+        uint32_t name;
+        uint32_t type;
+    };
+
+    struct ObjectSection
+    {
+        uint64_t start;
+        uint64_t size;
+        uint32_t name;
+        uint32_t reserved;
+    };
+
+    struct Object
+    {
+        uint32_t name;
+        uint32_t first_section; // Index of the object's first entry in the object section table.
+        uint32_t section_count;
+        uint32_t reserved;
+    };
+
+    struct Config
+    {
+        uint32_t code_align;
+        uint32_t data_align;
+        uint8_t code_pad;
+        uint8_t data_pad;
+    };
+
+public:
+    ConfigDatabase();
+    ConfigDatabase(const ConfigDatabase &) = delete;
+    ConfigDatabase &operator=(const ConfigDatabase &) = delete;
+    /**
+     * Files ending in .db are treated as databases, anything else as JSON.
+     */
+    static bool is_database(const char *file_name);
+    bool load(const char *file_name);
+    bool save(const char *file_name) const;
+    bool load_json(const char *file_name);
+    bool save_json(const char *file_name) const;
+    void from_json(const nlohmann::json &js);
+    void to_json(nlohmann::json &js) const;
+    void close();
+
+    unsigned flags() const { return m_flags; }
+    const Config &config() const { return m_config; }
+    const char *string(uint32_t offset) const { return m_strings + offset; }
+    size_t symbol_count() const { return m_symbolCount; }
+    const Symbol *symbols() const { return m_symbols; }
+    size_t section_count() const { return m_sectionCount; }
+    const Section *sections() const { return m_sections; }
+    size_t object_count() const { return m_objectCount; }
+    const Object *objects() const { return m_objects; }
+    const ObjectSection *object_sections() const { return m_objectSections; }
+
+    void set_config(const Config &config);
+    void set_flags(unsigned flags) { m_flags |= flags; }
+    void add_symbol(const std::string &name, uint64_t address, uint64_t size);
+    void add_section(const std::string &name, const std::string &type);
+    void add_object(const std::string &name);
+    void add_object_section(const std::string &name, uint64_t start, uint64_t size); // Adds to the last object.
+
+private:
+    uint32_t add_string(const std::string &str);
+    void update_views();
+
+private:
+    static const char s_magic[];
+
+    MappedFile m_file;
+    unsigned m_flags;
+    Config m_config;
+    // Point into the mapping once loaded, or into the build tables below.
+    const char *m_strings;
+    size_t m_stringSize;
+    const Symbol *m_symbols;
+    size_t m_symbolCount;
+    const Section *m_sections;
+    size_t m_sectionCount;
+    const Object *m_objects;
+    size_t m_objectCount;
+    const ObjectSection *m_objectSections;
+    size_t m_objectSectionCount;
+    // Only used while building.
+    std::string m_stringBlob;
+    std::unordered_map<std::string, uint32_t> m_stringOffsets;
+    std::vector<Symbol> m_symbolTable;
+    std::vector<Section> m_sectionTable;
+    std::vector<Object> m_objectTable;
+    std::vector<ObjectSection> m_objectSectionTable;
+};
+} // namespace unassemblize
@@ -0,0 +1,262 @@
+/**
+ * @file
+ *
+ * @brief Program wide graph of which functions reference which symbols.
+ *
+ * @copyright Assemblize is free software: you can redistribute it and/or
+ *            modify it under the terms of the GNU General Public License
+ *            as published by the Free Software Foundation, either version
+ *            3 of the License, or (at your option) any later version.
+ *            A full copy of the GNU General Public License can be found in
+ *            LICENSE
+ */
+#include "depgraph.h"
+#include "outputsink.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <nlohmann/json.hpp>
+#include <string.h>
+#include <unordered_map>
+
+namespace
+{
+// Layout is the header, the node table, the edge table then the string blob. Each node's edges are contiguous and
+// in node order, so a node's callees are edges[first_edge] to edges[first_edge + edge_count - 1].
+const uint32_t GRAPH_VERSION = 1;
+const char GRAPH_MAGIC[8] = "UNASDEP";
+
+struct GraphHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t node_count;
+    uint64_t edge_count;
+    uint64_t string_size;
+};
+
+struct GraphNode
+{
+    uint32_t name; // Offset into the string blob.
+    uint32_t flags;
+    uint32_t first_edge;
+    uint32_t edge_count;
+};
+
+struct GraphEdge
+{
+    uint32_t callee; // Node index.
+    uint32_t flags;
+};
+
+template<typename T> bool write_table(FILE *fp, const T *table, size_t count)
+{
+    return count == 0 || fwrite(table, sizeof(T), count, fp) == count;
+}
+
+void write_dot_string(unassemblize::OutputSink &output, const char *str)
+{
+    output.put('"');
+
+    for (; *str != '\0'; ++str) {
+        if (*str == '"' || *str == '\\') {
+            output.put('\\');
+        }
+
+        output.put(*str);
+    }
+
+    output.put('"');
+}
+} // namespace
+
+void unassemblize::DependencyGraph::add_function(uint32_t name, const std::vector<Function::Dependency> &deps)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_functions.push_back(name);
+
+    for (auto it = deps.begin(); it != deps.end(); ++it) {
+        m_edges.push_back({name, it->name, it->flags});
+    }
+}
+
+bool unassemblize::DependencyGraph::save(const char *file_name, const Executable &exe) const
+{
+    std::filesystem::path extension = std::filesystem::path(file_name).extension();
+
+    if (extension == ".dot") {
+        return save_dot(file_name, exe);
+    } else if (extension == ".json") {
+        return save_json(file_name, exe);
+    }
+
+    return save_binary(file_name, exe);
+}
+
+bool unassemblize::DependencyGraph::save_binary(const char *file_name, const Executable &exe) const
+{
+    std::vector<Node> nodes;
+    std::vector<Edge> edges;
+    build(exe, nodes, edges);
+
+    std::vector<GraphNode> node_table(nodes.size());
+    std::vector<GraphEdge> edge_table(edges.size());
+    std::string strings;
+
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        node_table[i] = {static_cast<uint32_t>(strings.size()), nodes[i].flags, 0, 0};
+        strings.append(exe.name(nodes[i].name), exe.name_length(nodes[i].name) + 1);
+    }
+
+    for (size_t i = 0; i < edges.size(); ++i) {
+        GraphNode &caller = node_table[edges[i].caller];
+
+        if (caller.edge_count == 0) {
+            caller.first_edge = static_cast<uint32_t>(i);
+        }
+
+        ++caller.edge_count;
+        edge_table[i] = {edges[i].callee, edges[i].flags};
+    }
+
+    GraphHeader header = {};
+    memcpy(header.magic, GRAPH_MAGIC, sizeof(header.magic));
+    header.version = GRAPH_VERSION;
+    header.node_count = node_table.size();
+    header.edge_count = edge_table.size();
+    header.string_size = strings.size();
+
+    FILE *fp = fopen(file_name, "wb");
+
+    if (fp == nullptr) {
+        return false;
+    }
+
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+    ok = ok && write_table(fp, node_table.data(), node_table.size());
+    ok = ok && write_table(fp, edge_table.data(), edge_table.size());
+    ok = ok && write_table(fp, strings.data(), strings.size());
+
+    return fclose(fp) == 0 && ok;
+}
+
+bool unassemblize::DependencyGraph::save_dot(const char *file_name, const Executable &exe) const
+{
+    std::vector<Node> nodes;
+    std::vector<Edge> edges;
+    build(exe, nodes, edges);
+
+    FileSink output(file_name);
+
+    if (!output.is_open()) {
+        return false;
+    }
+
+    // Symbols outside the output are boxes, data references dashed.
+    output.write("digraph dependencies {\n");
+
+    for (auto it = nodes.begin(); it != nodes.end(); ++it) {
+        if (!(it->flags & NODE_DEFINED)) {
+            output.write("    ");
+            write_dot_string(output, exe.name(it->name));
+            output.write(" [shape=box];\n");
+        }
+    }
+
+    for (auto it = edges.begin(); it != edges.end(); ++it) {
+        output.write("    ");
+        write_dot_string(output, exe.name(nodes[it->caller].name));
+        output.write(" -> ");
+        write_dot_string(output, exe.name(nodes[it->callee].name));
+        output.write(it->flags & Function::DEPENDENCY_CODE ? ";\n" : " [style=dashed];\n");
+    }
+
+    output.write("}\n");
+    output.flush();
+
+    return !output.failed();
+}
+
+bool unassemblize::DependencyGraph::save_json(const char *file_name, const Executable &exe) const
+{
+    std::vector<Node> nodes;
+    std::vector<Edge> edges;
+    build(exe, nodes, edges);
+
+    nlohmann::json j;
+    nlohmann::json &js_nodes = j["nodes"];
+    nlohmann::json &js_edges = j["edges"];
+    js_nodes = nlohmann::json::array();
+    js_edges = nlohmann::json::array();
+
+    for (auto it = nodes.begin(); it != nodes.end(); ++it) {
+        js_nodes.push_back({{"name", exe.name(it->name)}, {"defined", (it->flags & NODE_DEFINED) != 0}});
+    }
+
+    for (auto it = edges.begin(); it != edges.end(); ++it) {
+        js_edges.push_back({{"from", exe.name(nodes[it->caller].name)},
+            {"to", exe.name(nodes[it->callee].name)},
+            {"code", (it->flags & Function::DEPENDENCY_CODE) != 0},
+            {"data", (it->flags & Function::DEPENDENCY_DATA) != 0}});
+    }
+
+    std::ofstream fs(file_name);
+    fs << std::setw(4) << j << std::endl;
+
+    return fs.good();
+}
+
+void unassemblize::DependencyGraph::build(const Executable &exe, std::vector<Node> &nodes, std::vector<Edge> &edges) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<uint32_t> names(m_functions);
+
+    for (auto it = m_edges.begin(); it != m_edges.end(); ++it) {
+        names.push_back(it->callee);
+    }
+
+    // Ids depend on the order names were interned, sorting by the names themselves keeps the export stable.
+    std::sort(names.begin(), names.end());
+    names.erase(std::unique(names.begin(), names.end()), names.end());
+    std::sort(names.begin(), names.end(), [&exe](uint32_t a, uint32_t b) { return strcmp(exe.name(a), exe.name(b)) < 0; });
+
+    std::unordered_map<uint32_t, uint32_t> index;
+    index.reserve(names.size());
+    nodes.clear();
+    nodes.reserve(names.size());
+
+    for (size_t i = 0; i < names.size(); ++i) {
+        index.emplace(names[i], static_cast<uint32_t>(i));
+        nodes.push_back({names[i], 0});
+    }
+
+    for (auto it = m_functions.begin(); it != m_functions.end(); ++it) {
+        nodes[index[*it]].flags |= NODE_DEFINED;
+    }
+
+    edges.clear();
+    edges.reserve(m_edges.size());
+
+    for (auto it = m_edges.begin(); it != m_edges.end(); ++it) {
+        edges.push_back({index[it->caller], index[it->callee], it->flags});
+    }
+
+    std::sort(edges.begin(), edges.end(), [](const Edge &a, const Edge &b) {
+        return a.caller != b.caller ? a.caller < b.caller : a.callee < b.callee;
+    });
+
+    // A function added more than once, such as through overlapping objects, contributes one edge per callee.
+    size_t count = 0;
+
+    for (size_t i = 0; i < edges.size(); ++i) {
+        if (count != 0 && edges[count - 1].caller == edges[i].caller && edges[count - 1].callee == edges[i].callee) {
+            edges[count - 1].flags |= edges[i].flags;
+        } else {
+            edges[count++] = edges[i];
+        }
+    }
+
+    edges.resize(count);
+}
@@ -0,0 +1,73 @@
+/**
+ * @file
+ *
+ * @brief Program wide graph of which functions reference which symbols.
+ *
+ * @copyright Assemblize is free software: you can redistribute it and/or
+ *            modify it under the terms of the GNU General Public License
+ *            as published by the Free Software Foundation, either version
+ *            3 of the License, or (at your option) any later version.
+ *            A full copy of the GNU General Public License can be found in
+ *            LICENSE
+ */
+#pragma once
+
+#include "function.h"
+#include <mutex>
+#include <stdint.h>
+#include <vector>
+
+namespace unassemblize
+{
+/**
+ * Collects the dependencies of every function dissassembled in a run. Functions can be added from any thread.
+ * Exports list nodes in name order and edges in caller then callee order, so the same input always gives the same
+ * file whatever order functions finished in.
+ */
+class DependencyGraph
+{
+public:
+    enum NodeFlags
+    {
+        NODE_DEFINED = 1 << 0, // Dissassembled in this run, anything else is external to the output.
+    };
+
+public:
+    DependencyGraph() {}
+    DependencyGraph(const DependencyGraph &) = delete;
+    DependencyGraph &operator=(const DependencyGraph &) = delete;
+    /**
+     * Adds a function and everything it references, names are ids in the executable's pool.
+     */
+    void add_function(uint32_t name, const std::vector<Function::Dependency> &deps);
+    /**
+     * Files ending in .dot are written as Graphviz, .json as JSON and anything else in the binary format.
+     */
+    bool save(const char *file_name, const Executable &exe) const;
+    bool save_binary(const char *file_name, const Executable &exe) const;
+    bool save_dot(const char *file_name, const Executable &exe) const;
+    bool save_json(const char *file_name, const Executable &exe) const;
+
+private:
+    struct Edge
+    {
+        uint32_t caller;
+        uint32_t callee;
+        uint32_t flags;
+    };
+
+    struct Node
+    {
+        uint32_t name;
+        uint32_t flags;
+    };
+
+    // Nodes and edges in export order, edges refer to nodes by index.
+    void build(const Executable &exe, std::vector<Node> &nodes, std::vector<Edge> &edges) const;
+
+private:
+    std::vector<uint32_t> m_functions;
+    std::vector<Edge> m_edges;
+    mutable std::mutex m_mutex;
+};
+} // namespace unassemblize
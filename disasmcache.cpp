@@ -0,0 +1,196 @@
+/**
+ * @file
+ *
+ * @brief On disk store of previously dissassembled functions.
+ *
+ * @copyright Assemblize is free software: you can redistribute it and/or
+ *            modify it under the terms of the GNU General Public License
+ *            as published by the Free Software Foundation, either version
+ *            3 of the License, or (at your option) any later version.
+ *            A full copy of the GNU General Public License can be found in
+ *            LICENSE
+ */
+#include "disasmcache.h"
+#include <algorithm>
+#include <filesystem>
+#include <string.h>
+
+namespace
+{
+// Layout is the header followed by records, each one a record header then its lookups, dependencies and text,
+// padded to 8 bytes. Everything is in native byte order.
+const uint32_t CACHE_VERSION = 1;
+
+struct CacheHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t record_count;
+};
+
+struct RecordHeader
+{
+    uint64_t key;
+    uint32_t lookup_count;
+    uint32_t deps_size;
+    uint32_t text_size;
+    uint32_t reserved;
+};
+
+size_t record_size(const RecordHeader &header)
+{
+    size_t size = sizeof(RecordHeader) + header.lookup_count * sizeof(unassemblize::DisassemblyCache::Lookup)
+        + header.deps_size + header.text_size;
+
+    return (size + 7) & ~size_t(7);
+}
+} // namespace
+
+const char unassemblize::DisassemblyCache::s_magic[] = "UNASDIS";
+
+bool unassemblize::DisassemblyCache::load(const char *file_name)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries.clear();
+    m_kept.clear();
+    m_file.close();
+
+    if (!m_file.open(file_name) || m_file.size() < sizeof(CacheHeader)) {
+        m_file.close();
+        return false;
+    }
+
+    CacheHeader header;
+    memcpy(&header, m_file.data(), sizeof(header));
+
+    if (memcmp(header.magic, s_magic, sizeof(header.magic)) != 0 || header.version != CACHE_VERSION) {
+        m_file.close();
+        return false;
+    }
+
+    // Anything after a damaged record is dropped, the records before it are still good.
+    size_t offset = sizeof(header);
+    m_entries.reserve(header.record_count);
+
+    for (uint64_t i = 0; i < header.record_count && m_file.size() - offset >= sizeof(RecordHeader); ++i) {
+        RecordHeader record;
+        memcpy(&record, m_file.data() + offset, sizeof(record));
+        size_t size = record_size(record);
+
+        if (record.lookup_count > m_file.size() || size > m_file.size() - offset) {
+            break;
+        }
+
+        m_entries.emplace(record.key, m_file.data() + offset);
+        offset += size;
+    }
+
+    return true;
+}
+
+bool unassemblize::DisassemblyCache::save(const char *file_name)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::sort(m_kept.begin(), m_kept.end());
+    m_kept.erase(std::unique(m_kept.begin(), m_kept.end()), m_kept.end());
+
+    uint64_t record_count = m_kept.size();
+
+    for (size_t offset = 0; offset < m_added.size(); ++record_count) {
+        RecordHeader record;
+        memcpy(&record, m_added.data() + offset, sizeof(record));
+        offset += record_size(record);
+    }
+
+    CacheHeader header = {};
+    memcpy(header.magic, s_magic, sizeof(header.magic));
+    header.version = CACHE_VERSION;
+    header.record_count = record_count;
+
+    // Written under a temporary name and renamed so another run never sees half a cache.
+    std::error_code ec;
+    std::filesystem::path path(file_name);
+    std::filesystem::path temp_path = path;
+    temp_path += ".tmp";
+    FILE *fp = fopen(temp_path.string().c_str(), "wb");
+
+    if (fp == nullptr) {
+        return false;
+    }
+
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+
+    for (auto it = m_kept.begin(); ok && it != m_kept.end(); ++it) {
+        RecordHeader record;
+        memcpy(&record, *it, sizeof(record));
+        size_t size = record_size(record);
+        ok = fwrite(*it, 1, size, fp) == size;
+    }
+
+    ok = ok && (m_added.empty() || fwrite(m_added.data(), 1, m_added.size(), fp) == m_added.size());
+    ok = fclose(fp) == 0 && ok;
+
+    // The old mapping has to go before the rename, entries found so far are no longer usable.
+    m_entries.clear();
+    m_kept.clear();
+    m_added.clear();
+    m_file.close();
+
+    if (ok) {
+        std::filesystem::rename(temp_path, path, ec);
+        ok = !ec;
+    }
+
+    if (!ok) {
+        std::filesystem::remove(temp_path, ec);
+    }
+
+    return ok;
+}
+
+bool unassemblize::DisassemblyCache::find(uint64_t key, Entry &entry) const
+{
+    auto it = m_entries.find(key);
+
+    if (it == m_entries.end()) {
+        return false;
+    }
+
+    RecordHeader record;
+    memcpy(&record, it->second, sizeof(record));
+    entry.record = it->second;
+    entry.lookups = reinterpret_cast<const Lookup *>(it->second + sizeof(record));
+    entry.lookup_count = record.lookup_count;
+    entry.deps = reinterpret_cast<const char *>(entry.lookups + record.lookup_count);
+    entry.deps_size = record.deps_size;
+    entry.text = entry.deps + record.deps_size;
+    entry.text_size = record.text_size;
+
+    return true;
+}
+
+void unassemblize::DisassemblyCache::keep(const Entry &entry)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_kept.push_back(entry.record);
+}
+
+void unassemblize::DisassemblyCache::add(
+    uint64_t key, const std::vector<Lookup> &lookups, const std::string &deps, const std::string &text)
+{
+    RecordHeader record = {key,
+        static_cast<uint32_t>(lookups.size()),
+        static_cast<uint32_t>(deps.size()),
+        static_cast<uint32_t>(text.size()),
+        0};
+    size_t size = record_size(record);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    size_t offset = m_added.size();
+    m_added.append(reinterpret_cast<const char *>(&record), sizeof(record));
+    m_added.append(reinterpret_cast<const char *>(lookups.data()), lookups.size() * sizeof(Lookup));
+    m_added.append(deps);
+    m_added.append(text);
+    m_added.resize(offset + size, '\0');
+}
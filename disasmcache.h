@@ -0,0 +1,83 @@
+/**
+ * @file
+ *
+ * @brief On disk store of previously dissassembled functions.
+ *
+ * @copyright Assemblize is free software: you can redistribute it and/or
+ *            modify it under the terms of the GNU General Public License
+ *            as published by the Free Software Foundation, either version
+ *            3 of the License, or (at your option) any later version.
+ *            A full copy of the GNU General Public License can be found in
+ *            LICENSE
+ */
+#pragma once
+
+#include "mappedfile.h"
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace unassemblize
+{
+/**
+ * Rendered text and dependencies of functions keyed by a hash of everything that went into them, along with the
+ * lookups the function made so a caller can check they still give the same answers before using it.
+ * Entries are read straight from the mapped file. Saving writes the entries kept or added since loading, so
+ * functions that no longer exist drop out. Finds and adds may run on any thread.
+ */
+class DisassemblyCache
+{
+public:
+    enum LookupTypes
+    {
+        LOOKUP_SYMBOL,
+        LOOKUP_NEAREST_SYMBOL,
+        LOOKUP_BYTES, // Bytes read past the end of the function, which the key doesn't cover.
+    };
+
+    struct Lookup
+    {
+        uint64_t address;
+        uint64_t value; // Address of the symbol found, or the end of the byte range.
+        uint64_t hash; // Hash of the name of the symbol found, or of the bytes.
+        uint32_t type;
+        uint32_t reserved;
+    };
+
+    struct Entry
+    {
+        const uint8_t *record;
+        const Lookup *lookups;
+        size_t lookup_count;
+        const char *deps; // Each dependency is its 32 bit flags followed by its null terminated name.
+        size_t deps_size;
+        const char *text;
+        size_t text_size;
+    };
+
+public:
+    DisassemblyCache() {}
+    DisassemblyCache(const DisassemblyCache &) = delete;
+    DisassemblyCache &operator=(const DisassemblyCache &) = delete;
+    /**
+     * A missing or unreadable file leaves the cache empty.
+     */
+    bool load(const char *file_name);
+    bool save(const char *file_name);
+    bool find(uint64_t key, Entry &entry) const;
+    void keep(const Entry &entry); // Marks a found entry as still valid so save writes it.
+    void add(uint64_t key, const std::vector<Lookup> &lookups, const std::string &deps, const std::string &text);
+
+private:
+    static const char s_magic[];
+
+    MappedFile m_file;
+    std::unordered_map<uint64_t, const uint8_t *> m_entries; // Records in the mapping by key.
+    std::vector<const uint8_t *> m_kept;
+    std::string m_added; // New records in file layout.
+    std::mutex m_mutex;
+};
+} // namespace unassemblize
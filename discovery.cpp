@@ -0,0 +1,246 @@
+/**
+ * @file
+ *
+ * @brief Recursive descent discovery of function boundaries.
+ *
+ * @copyright Assemblize is free software: you can redistribute it and/or
+ *            modify it under the terms of the GNU General Public License
+ *            as published by the Free Software Foundation, either version
+ *            3 of the License, or (at your option) any later version.
+ *            A full copy of the GNU General Public License can be found in
+ *            LICENSE
+ */
+#include "discovery.h"
+#include "scanner.h"
+#include <algorithm>
+#include <inttypes.h>
+
+namespace
+{
+// Instructions kept from the current block for recovering jump tables, more than the switch pattern needs.
+const size_t MAX_HISTORY = 16;
+} // namespace
+
+unassemblize::Discovery::Discovery(Executable &exe, ZydisMachineMode mode) :
+    m_executable(exe), m_setup(Function::FORMAT_DEFAULT, mode)
+{
+    for (auto it = exe.sections().begin(); it != exe.sections().end(); ++it) {
+        if (it->second.type == Executable::SECTION_CODE && it->second.data != nullptr) {
+            m_sections.push_back({it->second.data, it->second.address, it->second.size});
+        }
+    }
+
+    std::sort(m_sections.begin(), m_sections.end(), [](const CodeSection &a, const CodeSection &b) {
+        return a.address < b.address;
+    });
+}
+
+void unassemblize::Discovery::add_seed(uint64_t address)
+{
+    if (find_section(address) != nullptr && m_starts.insert(address).second) {
+        m_pending.push_back(address);
+    }
+}
+
+void unassemblize::Discovery::add_default_seeds()
+{
+    add_seed(m_executable.entry_point());
+
+    for (size_t i = 0; i < m_executable.symbols().size(); ++i) {
+        add_seed(m_executable.symbols().address(i));
+    }
+}
+
+void unassemblize::Discovery::add_scanned_seeds()
+{
+    PrologueScanner scanner;
+    std::vector<uint64_t> candidates;
+
+    for (auto it = m_sections.begin(); it != m_sections.end(); ++it) {
+        scanner.scan(it->data, it->size, it->address, candidates);
+    }
+
+    for (auto it = candidates.begin(); it != candidates.end(); ++it) {
+        add_seed(*it);
+    }
+}
+
+void unassemblize::Discovery::run()
+{
+    // First find every function start by following calls until no new ones turn up. Extents found while doing this
+    // depend on the order starts were found in, so they are worked out afterwards once all the starts are known.
+    while (!m_pending.empty()) {
+        uint64_t start = m_pending.back();
+        m_pending.pop_back();
+        explore(start, false);
+    }
+
+    m_functions.clear();
+
+    for (auto it = m_starts.begin(); it != m_starts.end(); ++it) {
+        m_functions[*it] = explore(*it, true);
+    }
+}
+
+void unassemblize::Discovery::apply()
+{
+    char name[32];
+
+    for (auto it = m_functions.begin(); it != m_functions.end(); ++it) {
+        // Nothing decoded at this start, probably not code after all.
+        if (it->second == it->first) {
+            continue;
+        }
+
+        snprintf(name, sizeof(name), "sub_%" PRIx64, it->first);
+        m_executable.add_symbol(name, it->first, it->second - it->first);
+    }
+}
+
+uint64_t unassemblize::Discovery::follow_jump_table(const std::vector<Function::DecodedInstruction> &history,
+    uint64_t start, uint64_t end, std::vector<uint64_t> &blocks) const
+{
+    Function::JumpTable table;
+
+    if (!Function::find_jump_table(
+            m_executable, m_setup.machine_mode(), history.data(), history.size(), start, end - 1, table)) {
+        return start;
+    }
+
+    const uint8_t *entries = Function::table_data(m_executable, table.address, uint64_t(table.count) * table.entry_size);
+
+    // Each case is code of this function, not the start of a new one.
+    for (uint32_t i = 0; i < table.count; ++i) {
+        const uint8_t *entry = entries + uint64_t(i) * table.entry_size;
+        uint64_t target = Function::table_entry(entry, table.entry_size);
+
+        if (target > start && target < end && m_starts.count(target) == 0) {
+            blocks.push_back(target);
+        }
+    }
+
+    // Tables placed inside the function's code are part of it.
+    uint64_t table_end = start;
+
+    if (table.address >= start && table.address < end) {
+        table_end = std::min(end, table.address + uint64_t(table.count) * table.entry_size);
+    }
+
+    if (table.index_address >= start && table.index_address < end) {
+        table_end = std::max(table_end, std::min(end, table.index_address + table.index_count));
+    }
+
+    return table_end;
+}
+
+const unassemblize::Discovery::CodeSection *unassemblize::Discovery::find_section(uint64_t address) const
+{
+    auto it = std::upper_bound(m_sections.begin(), m_sections.end(), address, [](uint64_t addr, const CodeSection &sec) {
+        return addr < sec.address;
+    });
+
+    if (it == m_sections.begin()) {
+        return nullptr;
+    }
+
+    --it;
+
+    return address < it->address + it->size ? &*it : nullptr;
+}
+
+uint64_t unassemblize::Discovery::explore(uint64_t start, bool bounded)
+{
+    const CodeSection *section = find_section(start);
+    uint64_t section_end = section->address + section->size;
+
+    // When bounded the function can't run into the next known function.
+    if (bounded) {
+        auto next = m_starts.upper_bound(start);
+
+        if (next != m_starts.end() && *next < section_end) {
+            section_end = *next;
+        }
+    }
+
+    std::vector<uint64_t> blocks(1, start);
+    std::set<uint64_t> visited;
+    uint64_t end = start;
+    std::vector<Function::DecodedInstruction> history; // Straight line code leading up to the current instruction.
+    history.reserve(MAX_HISTORY * 2);
+
+    while (!blocks.empty()) {
+        uint64_t address = blocks.back();
+        blocks.pop_back();
+        history.clear();
+
+        // Follow the block until control flow leaves it or we reach code we already followed.
+        while (address < section_end && visited.insert(address).second) {
+            uint64_t offset = address - section->address;
+            ZyanUSize length = std::min<uint64_t>(section_end - address, ZYDIS_MAX_INSTRUCTION_LENGTH);
+
+            // Older instructions are dropped in batches, reserving up front keeps the references below valid.
+            if (history.size() == MAX_HISTORY * 2) {
+                history.erase(history.begin(), history.begin() + MAX_HISTORY);
+            }
+
+            history.emplace_back();
+            Function::DecodedInstruction &decoded = history.back();
+            const ZydisDecodedInstruction &info = decoded.info;
+            const ZydisDecodedOperand *operands = decoded.operands;
+
+            if (!ZYAN_SUCCESS(m_setup.decode(section->data + offset, length, &decoded.info, decoded.operands))) {
+                break;
+            }
+
+            uint64_t next = address + info.length;
+            end = std::max(end, next);
+
+            uint64_t target = 0;
+            bool has_target = info.operand_count_visible > 0 && operands[0].type == ZYDIS_OPERAND_TYPE_IMMEDIATE
+                && operands[0].imm.is_relative
+                && ZYAN_SUCCESS(ZydisCalcAbsoluteAddress(&info, &operands[0], address, &target));
+
+            switch (info.meta.category) {
+                case ZYDIS_CATEGORY_CALL:
+                    if (has_target && !bounded) {
+                        add_seed(target);
+                    }
+                    break;
+                case ZYDIS_CATEGORY_COND_BR:
+                    if (has_target && target >= start && target < section_end) {
+                        blocks.push_back(target);
+                    }
+                    break;
+                case ZYDIS_CATEGORY_UNCOND_BR:
+                    // Jumps backwards past our start or to another function are tail calls.
+                    if (has_target && target > start && target < section_end && m_starts.count(target) == 0) {
+                        blocks.push_back(target);
+                    } else if (has_target && !bounded) {
+                        add_seed(target);
+                    } else if (!has_target) {
+                        end = std::max(end, follow_jump_table(history, start, section_end, blocks));
+                    }
+                    next = section_end;
+                    break;
+                case ZYDIS_CATEGORY_RET:
+                    next = section_end;
+                    break;
+                default:
+                    if (info.mnemonic == ZYDIS_MNEMONIC_INT3 || info.mnemonic == ZYDIS_MNEMONIC_HLT
+                        || info.mnemonic == ZYDIS_MNEMONIC_UD2) {
+                        next = section_end;
+                    }
+                    break;
+            }
+
+            // Falling through into the start of another function ends this one.
+            if (next != section_end && m_starts.count(next) != 0) {
+                break;
+            }
+
+            address = next;
+        }
+    }
+
+    return end;
+}
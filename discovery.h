@@ -0,0 +1,74 @@
+/**
+ * @file
+ *
+ * @brief Recursive descent discovery of function boundaries.
+ *
+ * @copyright Assemblize is free software: you can redistribute it and/or
+ *            modify it under the terms of the GNU General Public License
+ *            as published by the Free Software Foundation, either version
+ *            3 of the License, or (at your option) any later version.
+ *            A full copy of the GNU General Public License can be found in
+ *            LICENSE
+ */
+#pragma once
+
+#include "function.h"
+#include <map>
+#include <set>
+#include <stdint.h>
+#include <vector>
+
+namespace unassemblize
+{
+class Discovery
+{
+public:
+    Discovery(Executable &exe, ZydisMachineMode mode = ZYDIS_MACHINE_MODE_LEGACY_32);
+    /**
+     * Adds an address known to start a function.
+     */
+    void add_seed(uint64_t address);
+    /**
+     * Seeds from the entry point and every symbol in a code section, which covers exports and config symbols.
+     */
+    void add_default_seeds();
+    /**
+     * Seeds from a prologue scan of every code section, finds functions nothing known calls directly.
+     */
+    void add_scanned_seeds();
+    /**
+     * Follows calls and jumps from the seeds to find every reachable function and where each one ends.
+     */
+    void run();
+    /**
+     * Adds a sized symbol for each function found, named sub_<address> if it doesn't have one already.
+     */
+    void apply();
+    const std::map<uint64_t, uint64_t> &functions() const { return m_functions; } // Start to end, end is exclusive.
+
+private:
+    struct CodeSection
+    {
+        const uint8_t *data;
+        uint64_t address;
+        uint64_t size;
+    };
+
+    const CodeSection *find_section(uint64_t address) const;
+    uint64_t explore(uint64_t start, bool bounded);
+    /**
+     * Recovers the table of the indirect jump ending history, adds the cases between start and end to the blocks to
+     * follow and returns where the table ends if it is inside the function, otherwise start.
+     */
+    uint64_t follow_jump_table(const std::vector<Function::DecodedInstruction> &history, uint64_t start, uint64_t end,
+        std::vector<uint64_t> &blocks) const;
+
+private:
+    Executable &m_executable;
+    FunctionSetup m_setup;
+    std::vector<CodeSection> m_sections;
+    std::set<uint64_t> m_starts; // Every known function start.
+    std::vector<uint64_t> m_pending; // Starts that still need exploring for calls.
+    std::map<uint64_t, uint64_t> m_functions;
+};
+} // namespace unassemblize
@@ -11,48 +11,169 @@
  *            LICENSE
  */
 #include "executable.h"
+#include "configdb.h"
+#include "depgraph.h"
 #include "function.h"
+#include "hash.h"
+#include "outputsink.h"
+#include "threadpool.h"
 #include <LIEF/LIEF.hpp>
+#include <algorithm>
+#include <filesystem>
 #include <fstream>
+#include <inttypes.h>
 #include <iostream>
+#include <mutex>
 #include <nlohmann/json.hpp>
+#include <string.h>
 #include <strings.h>
 
 const char unassemblize::Executable::s_symbolSection[] = "symbols";
 const char unassemblize::Executable::s_sectionsSection[] = "sections";
 const char unassemblize::Executable::s_configSection[] = "config";
 const char unassemblize::Executable::s_objectSection[] = "objects";
+const char unassemblize::Executable::s_snapshotMagic[] = "UNASNAP";
 
-unassemblize::Executable::Executable(const char *file_name, OutputFormats format, bool verbose) :
-    m_binary(LIEF::Parser::parse(file_name)),
-    m_endAddress(0),
+namespace
+{
+// Snapshot layout is the header, the section table, the symbol table sorted by address, then the null terminated
+// names that the tables refer to by offset. Everything is in native byte order.
+const uint32_t SNAPSHOT_VERSION = 3;
+
+// Bytes of code dissassemble_all runs at once with several jobs, bounds how much finished text waits to be written.
+const uint64_t REORDER_WINDOW = 1 << 20;
+
+struct SnapshotHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t section_count;
+    uint64_t file_size;
+    uint64_t content_hash;
+    uint64_t image_base;
+    uint64_t entry_point;
+    uint64_t end_address;
+    uint64_t symbol_count;
+    uint64_t string_size;
+    uint32_t address_width;
+    uint32_t reserved;
+};
+
+struct SnapshotSection
+{
+    uint64_t address;
+    uint64_t size;
+    uint64_t offset; // File offset of the contents, all bits set if there are none.
+    uint32_t name;
+    uint32_t type;
+};
+
+struct SnapshotSymbol
+{
+    uint64_t address;
+    uint64_t size;
+    uint32_t name;
+    uint32_t reserved;
+};
+
+std::unique_ptr<LIEF::Binary> parse_binary(const char *file_name)
+{
+    // Skip the parts of a PE we never look at, the signature and resources can be large.
+    if (LIEF::PE::is_pe(file_name)) {
+        LIEF::PE::ParserConfig config;
+        config.parse_signature = false;
+        config.parse_rsrc = false;
+        config.parse_reloc = false;
+        return LIEF::PE::Parser::parse(file_name, config);
+    }
+
+    return LIEF::Parser::parse(file_name);
+}
+} // namespace
+
+unassemblize::Executable::Executable(
+    const char *file_name, OutputFormats format, bool verbose, const char *cache_dir) :
+    m_fileName(std::filesystem::path(file_name).filename().string()),
+    m_dependencyGraph(nullptr),
+    m_layoutHash(0),
     m_outputFormat(format),
+    m_imageBase(0),
+    m_addressWidth(32),
+    m_endAddress(0),
+    m_entryPoint(0),
     m_codeAlignment(sizeof(uint32_t)),
     m_dataAlignment(sizeof(uint32_t)),
     m_codePad(0x90), // NOP
     m_dataPad(0x00),
     m_verbose(verbose),
-    m_addBase(false)
+    m_addBase(false),
+    m_journalLoaded(false)
+{
+    // Section contents are read straight from the mapping, LIEF is only needed until everything is indexed.
+    if (!m_file.open(file_name)) {
+        printf("Failed to map '%s' into memory.\n", file_name);
+    }
+
+    std::string snapshot;
+    uint64_t hash = 0;
+
+    if (cache_dir != nullptr && m_file.is_open()) {
+        char name[32];
+        hash = hash_bytes(m_file.data(), m_file.size());
+        snprintf(name, sizeof(name), "%016" PRIx64 ".snap", hash);
+        snapshot = (std::filesystem::path(cache_dir) / name).string();
+        snprintf(name, sizeof(name), "%016" PRIx64 ".dis", hash);
+        m_disassemblyCacheFile = (std::filesystem::path(cache_dir) / name).string();
+        m_disassemblyCache.reset(new DisassemblyCache);
+
+        if (load_snapshot(snapshot.c_str(), hash)) {
+            build_regions();
+            return;
+        }
+    }
+
+    load_binary(file_name);
+    build_regions();
+
+    if (!snapshot.empty()) {
+        save_snapshot(snapshot.c_str(), hash);
+    }
+}
+
+void unassemblize::Executable::load_binary(const char *file_name)
 {
+    std::unique_ptr<LIEF::Binary> binary = parse_binary(file_name);
+    m_imageBase = binary->imagebase();
+    m_entryPoint = binary->entrypoint();
+    m_addressWidth = binary->header().is_64() ? 64 : 32;
+
     if (m_verbose) {
         printf("Loading section info...\n");
     }
 
     bool checked_image_base = false;
 
-    for (auto it = m_binary->sections().begin(); it != m_binary->sections().end(); ++it) {
+    for (auto it = binary->sections().begin(); it != binary->sections().end(); ++it) {
         if (!it->name().empty() && it->size() != 0) {
             SectionInfo &section = m_sections[it->name()];
-            section.data = it->content().data();
+            m_sectionNames.push_back(it->name());
+
+            // Sections with no file data such as an ELF .bss still report an offset and size, but LIEF gives them no
+            // content. Only point into the mapping when there is content and all of it is inside the file.
+            if (!it->content().empty() && it->offset() <= m_file.size() && it->size() <= m_file.size() - it->offset()) {
+                section.data = m_file.data() + it->offset();
+            } else {
+                section.data = nullptr;
+            }
 
             // Check on first section incase binary is huge and later sections start higher than imagebase.
-            if (!checked_image_base && it->virtual_address() <= m_binary->imagebase()) {
+            if (!checked_image_base && it->virtual_address() <= m_imageBase) {
                 m_addBase = true;
             }
 
             // For PE format virtual_address appears to be an offset, in ELF/Mach-O it appears to be absolute.
             if (m_addBase) {
-                section.address = m_binary->imagebase() + it->virtual_address();
+                section.address = m_imageBase + it->virtual_address();
             } else {
                 section.address = it->virtual_address();
             }
@@ -65,7 +186,7 @@ unassemblize::Executable::Executable(const char *file_name, OutputFormats format
 
             // Naive split on whether section contains data or code... have entrypoint? Code, else data.
             // Needs to be refined by providing a config file with section types specified.
-            if (section.address <= m_binary->entrypoint() && section.address + section.size >= m_binary->entrypoint()) {
+            if (section.address <= m_entryPoint && section.address + section.size >= m_entryPoint) {
                 section.type = SECTION_CODE;
             } else {
                 section.type = SECTION_DATA;
@@ -77,24 +198,190 @@ unassemblize::Executable::Executable(const char *file_name, OutputFormats format
         printf("Indexing embedded symbols...\n");
     }
 
-    auto exe_syms = m_binary->symbols();
+    auto exe_syms = binary->symbols();
+    auto exe_imports = binary->imported_functions();
+    auto exe_exports = binary->exported_functions();
+    m_symbols.reserve(exe_syms.size() + exe_imports.size() + exe_exports.size());
 
+    // Where several symbols share an address the index keeps the first one added.
     for (auto it = exe_syms.begin(); it != exe_syms.end(); ++it) {
-        if (it->value() != 0 && !it->name().empty() && m_symbolMap.find(it->value()) == m_symbolMap.end()) {
-            uint64_t value = it->value() > m_binary->imagebase() ? it->value() : it->value() + m_binary->imagebase();
-            m_symbolMap.insert({it->value(), Symbol(it->name(), value, it->size())});
+        if (it->value() != 0 && !it->name().empty()) {
+            uint64_t value = it->value() > m_imageBase ? it->value() : it->value() + m_imageBase;
+            m_symbols.insert(value, m_names.intern(it->name()), it->size());
         }
     }
 
-    auto exe_imports = m_binary->imported_functions();
-
     for (auto it = exe_imports.begin(); it != exe_imports.end(); ++it) {
-        if (it->value() != 0 && !it->name().empty() && m_symbolMap.find(it->value()) == m_symbolMap.end()) {
-            uint64_t value = it->value() > m_binary->imagebase() ? it->value() : it->value() + m_binary->imagebase();
-            m_loadedSymbols.push_back(it->name());
-            m_symbolMap.insert({it->value(), Symbol(m_loadedSymbols.back(), value, it->size())});
+        if (it->value() != 0 && !it->name().empty()) {
+            uint64_t value = it->value() > m_imageBase ? it->value() : it->value() + m_imageBase;
+            m_symbols.insert(value, m_names.intern(it->name()), it->size());
         }
     }
+
+    for (auto it = exe_exports.begin(); it != exe_exports.end(); ++it) {
+        if (it->address() != 0 && !it->name().empty()) {
+            uint64_t value = it->address() > m_imageBase ? it->address() : it->address() + m_imageBase;
+            m_symbols.insert(value, m_names.intern(it->name()), it->size());
+        }
+    }
+
+    // Nothing refers into the LIEF binary now, it is freed as it goes out of scope.
+}
+
+bool unassemblize::Executable::load_snapshot(const char *file_name, uint64_t hash)
+{
+    MappedFile snapshot;
+
+    if (!snapshot.open(file_name) || snapshot.size() < sizeof(SnapshotHeader)) {
+        return false;
+    }
+
+    SnapshotHeader header;
+    memcpy(&header, snapshot.data(), sizeof(header));
+
+    if (memcmp(header.magic, s_snapshotMagic, sizeof(header.magic)) != 0 || header.version != SNAPSHOT_VERSION
+        || header.content_hash != hash || header.file_size != m_file.size()
+        || header.symbol_count > snapshot.size() || header.string_size > snapshot.size()) {
+        return false;
+    }
+
+    const uint8_t *data = snapshot.data() + sizeof(header);
+    uint64_t tables_size = header.section_count * sizeof(SnapshotSection) + header.symbol_count * sizeof(SnapshotSymbol);
+
+    if (snapshot.size() != sizeof(header) + tables_size + header.string_size
+        || (header.string_size != 0 && data[tables_size + header.string_size - 1] != '\0')) {
+        return false;
+    }
+
+    const char *strings = reinterpret_cast<const char *>(data + tables_size);
+    const SnapshotSection *sections = reinterpret_cast<const SnapshotSection *>(data);
+    const SnapshotSymbol *symbols = reinterpret_cast<const SnapshotSymbol *>(sections + header.section_count);
+
+    // Check every name before touching anything so a bad snapshot falls back to parsing cleanly.
+    for (uint32_t i = 0; i < header.section_count; ++i) {
+        if (sections[i].name >= header.string_size) {
+            return false;
+        }
+    }
+
+    for (uint64_t i = 0; i < header.symbol_count; ++i) {
+        if (symbols[i].name >= header.string_size) {
+            return false;
+        }
+    }
+
+    if (m_verbose) {
+        printf("Loading snapshot '%s'...\n", file_name);
+    }
+
+    for (uint32_t i = 0; i < header.section_count; ++i) {
+        const SnapshotSection &entry = sections[i];
+        SectionInfo &section = m_sections[strings + entry.name];
+        m_sectionNames.push_back(strings + entry.name);
+        section.data = nullptr;
+
+        // Sections saved without file data have an offset of UINT64_MAX.
+        if (entry.offset != UINT64_MAX && entry.offset <= m_file.size() && entry.size <= m_file.size() - entry.offset) {
+            section.data = m_file.data() + entry.offset;
+        }
+
+        section.address = entry.address;
+        section.size = entry.size;
+        section.type = static_cast<SectionTypes>(entry.type);
+    }
+
+    m_symbols.reserve(header.symbol_count);
+
+    for (uint64_t i = 0; i < header.symbol_count; ++i) {
+        m_symbols.insert(symbols[i].address, m_names.intern(strings + symbols[i].name), symbols[i].size);
+    }
+
+    m_imageBase = header.image_base;
+    m_addressWidth = header.address_width;
+    m_entryPoint = header.entry_point;
+    m_endAddress = header.end_address;
+
+    return true;
+}
+
+void unassemblize::Executable::save_snapshot(const char *file_name, uint64_t hash)
+{
+    if (m_verbose) {
+        printf("Saving snapshot '%s'...\n", file_name);
+    }
+
+    std::vector<SnapshotSection> sections;
+    std::vector<SnapshotSymbol> symbols;
+    std::string strings;
+    std::vector<uint32_t> string_offsets(m_names.size(), UINT32_MAX);
+
+    auto add_string = [&](uint32_t id) {
+        if (string_offsets[id] == UINT32_MAX) {
+            string_offsets[id] = static_cast<uint32_t>(strings.size());
+            strings.append(m_names.c_str(id), m_names.length(id) + 1);
+        }
+
+        return string_offsets[id];
+    };
+
+    for (auto it = m_sectionNames.begin(); it != m_sectionNames.end(); ++it) {
+        const SectionInfo &section = m_sections.at(*it);
+        uint64_t offset = section.data != nullptr ? section.data - m_file.data() : UINT64_MAX;
+        sections.push_back({section.address, section.size, offset, add_string(m_names.intern(*it)), section.type});
+    }
+
+    symbols.reserve(m_symbols.size());
+
+    for (size_t i = 0; i < m_symbols.size(); ++i) {
+        symbols.push_back({m_symbols.address(i), m_symbols.symbol_size(i), add_string(m_symbols.name(i)), 0});
+    }
+
+    SnapshotHeader header = {};
+    memcpy(header.magic, s_snapshotMagic, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.section_count = static_cast<uint32_t>(sections.size());
+    header.file_size = m_file.size();
+    header.content_hash = hash;
+    header.image_base = m_imageBase;
+    header.entry_point = m_entryPoint;
+    header.end_address = m_endAddress;
+    header.symbol_count = symbols.size();
+    header.string_size = strings.size();
+    header.address_width = m_addressWidth;
+
+    // Written under a temporary name and renamed so another run never sees half a snapshot.
+    std::error_code ec;
+    std::filesystem::path path(file_name);
+    std::filesystem::create_directories(path.parent_path(), ec);
+    std::filesystem::path temp_path = path;
+    temp_path += ".tmp";
+    FILE *fp = fopen(temp_path.string().c_str(), "wb");
+
+    if (fp == nullptr) {
+        if (m_verbose) {
+            printf("Failed to open '%s' to write the snapshot.\n", temp_path.string().c_str());
+        }
+
+        return;
+    }
+
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+    ok = ok && fwrite(sections.data(), sizeof(SnapshotSection), sections.size(), fp) == sections.size();
+    ok = ok && fwrite(symbols.data(), sizeof(SnapshotSymbol), symbols.size(), fp) == symbols.size();
+    ok = ok && fwrite(strings.data(), 1, strings.size(), fp) == strings.size();
+    ok = fclose(fp) == 0 && ok;
+
+    if (ok) {
+        std::filesystem::rename(temp_path, path, ec);
+    } else {
+        std::filesystem::remove(temp_path, ec);
+    }
+}
+
+const unassemblize::Executable::SectionInfo *unassemblize::Executable::section_info(const char *name) const
+{
+    auto it = m_sections.find(name);
+    return it != m_sections.end() ? &it->second : nullptr;
 }
 
 const uint8_t *unassemblize::Executable::section_data(const char *name) const
@@ -115,82 +402,331 @@ uint64_t unassemblize::Executable::section_size(const char *name) const
     return it != m_sections.end() ? it->second.size : 0;
 }
 
-uint64_t unassemblize::Executable::base_address() const
+const unassemblize::Executable::Region *unassemblize::Executable::classify(uint64_t addr) const
 {
-    return m_binary->imagebase();
+    auto it = std::upper_bound(
+        m_regions.begin(), m_regions.end(), addr, [](uint64_t addr, const Region &region) { return addr < region.start; });
+
+    if (it == m_regions.begin()) {
+        return nullptr;
+    }
+
+    --it;
+
+    return addr < it->end ? &*it : nullptr;
 }
 
-const unassemblize::Executable::Symbol &unassemblize::Executable::get_symbol(uint64_t addr) const
+void unassemblize::Executable::build_regions()
 {
-    static std::string empty;
-    static Symbol def(empty, 0, 0);
-    auto it = m_symbolMap.find(addr);
+    std::vector<const SectionInfo *> sorted;
 
-    if (it != m_symbolMap.end()) {
-        return it->second;
+    for (auto it = m_sections.begin(); it != m_sections.end(); ++it) {
+        sorted.push_back(&it->second);
     }
 
-    return def;
+    std::sort(sorted.begin(), sorted.end(), [](const SectionInfo *a, const SectionInfo *b) {
+        return a->address < b->address;
+    });
+
+    // Gaps between sections from the image base up to and including the end address still count as the image.
+    uint64_t covered = m_imageBase;
+
+    for (auto it = sorted.begin(); it != sorted.end(); ++it) {
+        uint64_t start = m_regions.empty() ? (*it)->address : std::max((*it)->address, m_regions.back().end);
+        uint64_t end = (*it)->address + (*it)->size;
+
+        if (start >= end) {
+            continue;
+        }
+
+        if (covered < start) {
+            m_regions.push_back({covered, start, nullptr});
+        }
+
+        m_regions.push_back({start, end, *it});
+        covered = std::max(covered, end);
+    }
+
+    if (covered <= m_endAddress) {
+        m_regions.push_back({covered, m_endAddress + 1, nullptr});
+    }
 }
 
-const unassemblize::Executable::Symbol &unassemblize::Executable::get_nearest_symbol(uint64_t addr) const
+unassemblize::Executable::Symbol unassemblize::Executable::symbol(size_t pos) const
 {
-    static std::string empty;
-    static Symbol def(empty, 0, 0);
-    auto it = m_symbolMap.lower_bound(addr);
+    return Symbol(m_symbols.name(pos), m_symbols.address(pos), m_symbols.symbol_size(pos));
+}
 
-    if (it != m_symbolMap.end()) {
-        if (it->second.value == addr) {
-            return it->second;
-        } else {
-            return std::prev(it)->second;
-        }
+unassemblize::Executable::Symbol unassemblize::Executable::get_symbol(uint64_t addr) const
+{
+    size_t pos = m_symbols.find(addr);
+
+    if (pos != SymbolIndex::npos) {
+        return symbol(pos);
     }
 
-    return def;
+    return Symbol(StringPool::empty, 0, 0);
 }
 
-void unassemblize::Executable::add_symbol(const char *sym, uint64_t addr)
+unassemblize::Executable::Symbol unassemblize::Executable::get_nearest_symbol(uint64_t addr) const
 {
-    if (m_symbolMap.find(addr) == m_symbolMap.end()) {
-        m_loadedSymbols.push_back(sym);
-        m_symbolMap.insert({addr, Symbol(m_loadedSymbols.back(), addr, 0)});
+    size_t pos = m_symbols.find_nearest(addr);
+
+    // A symbol with a known size only covers addresses up to its end.
+    if (pos != SymbolIndex::npos
+        && (m_symbols.symbol_size(pos) == 0 || addr - m_symbols.address(pos) < m_symbols.symbol_size(pos))) {
+        return symbol(pos);
     }
+
+    return Symbol(StringPool::empty, 0, 0);
 }
 
-void unassemblize::Executable::load_config(const char *file_name)
+void unassemblize::Executable::add_symbol(const char *sym, uint64_t addr, uint64_t size)
 {
-    if (m_verbose) {
-        printf("Loading config file '%s'...\n", file_name);
+    // Looking up with find would merge the queue on every call while discovery adds its functions one at a time.
+    size_t pos = m_symbols.find_merged(addr);
+
+    if (pos != SymbolIndex::npos) {
+        if (m_symbols.symbol_size(pos) != 0 || size == 0) {
+            return;
+        }
+    } else if (size == 0 && m_newSymbols.find(addr) != m_newSymbols.end()) {
+        return; // Already queued, the merge keeps the first symbol at an address.
     }
 
-    std::ifstream fs(file_name);
+    m_symbols.insert(addr, m_names.intern(sym), size);
+    m_newSymbols.insert(addr);
+}
 
-    if (!fs.good()) {
-        return;
+/**
+ * Reads a JSON config as a stream of parse events, adding each entry to the executable as soon as it is complete.
+ * Keys other than the ones an Executable knows about are skipped whatever they hold.
+ */
+class unassemblize::Executable::ConfigHandler : public nlohmann::json::json_sax_t
+{
+    enum State
+    {
+        STATE_ROOT,
+        STATE_CONFIG,
+        STATE_SYMBOLS,
+        STATE_SYMBOL,
+        STATE_SECTIONS,
+        STATE_SECTION,
+        STATE_OBJECTS,
+        STATE_OBJECT,
+        STATE_OBJECT_SECTIONS,
+        STATE_OBJECT_SECTION,
+        STATE_SKIP,
+    };
+
+    enum Settings
+    {
+        SETTING_CODE_ALIGN = 1 << 0,
+        SETTING_DATA_ALIGN = 1 << 1,
+        SETTING_CODE_PAD = 1 << 2,
+        SETTING_DATA_PAD = 1 << 3,
+        SETTINGS_ALL = (1 << 4) - 1,
+    };
+
+public:
+    explicit ConfigHandler(Executable &exe) : m_exe(exe), m_address(0), m_size(0), m_found(0), m_settings(0) {}
+
+    bool null() override { return true; }
+    bool boolean(bool) override { return true; }
+    bool number_integer(number_integer_t val) override { return number(static_cast<uint64_t>(val)); }
+    bool number_unsigned(number_unsigned_t val) override { return number(val); }
+    bool number_float(number_float_t val, const string_t &) override { return number(static_cast<uint64_t>(val)); }
+    bool binary(binary_t &) override { return true; }
+
+    bool string(string_t &val) override
+    {
+        if (in_entry()) {
+            if (m_key == "name") {
+                m_name = val;
+            } else if (m_key == "type") {
+                m_type = val;
+            }
+        } else if (!m_stack.empty() && m_stack.back() == STATE_OBJECT && m_key == "name") {
+            m_object.name = val;
+        }
+
+        return true;
     }
 
-    nlohmann::json j = nlohmann::json::parse(fs);
+    bool key(string_t &val) override
+    {
+        m_key = val;
+        return true;
+    }
+
+    bool start_object(std::size_t) override
+    {
+        State state = STATE_SKIP;
+
+        if (m_stack.empty()) {
+            state = STATE_ROOT;
+        } else if (m_stack.back() == STATE_ROOT && m_key == s_configSection) {
+            state = STATE_CONFIG;
+        } else if (m_stack.back() == STATE_SYMBOLS) {
+            state = STATE_SYMBOL;
+        } else if (m_stack.back() == STATE_SECTIONS) {
+            state = STATE_SECTION;
+        } else if (m_stack.back() == STATE_OBJECTS) {
+            state = STATE_OBJECT;
+            m_object = Object();
+        } else if (m_stack.back() == STATE_OBJECT_SECTIONS) {
+            state = STATE_OBJECT_SECTION;
+        }
+
+        m_stack.push_back(state);
+
+        // Fields of an entry are collected then applied once the whole entry has been read.
+        if (in_entry()) {
+            m_name.clear();
+            m_type.clear();
+            m_address = 0;
+            m_size = 0;
+        }
+
+        return true;
+    }
+
+    bool end_object() override
+    {
+        switch (m_stack.back()) {
+            case STATE_SYMBOL:
+                // Only load symbols for addresses we don't have any symbol for yet, the index keeps the first.
+                if (!m_name.empty() && m_address != 0) {
+                    m_exe.m_symbols.insert(m_address, m_exe.m_names.intern(m_name), m_size);
+                }
+                break;
+            case STATE_SECTION:
+                if (!m_name.empty()) {
+                    m_exe.set_section_type(m_name, m_type.c_str());
+                }
+                break;
+            case STATE_OBJECT_SECTION:
+                m_object.sections.push_back({m_name, m_address, m_size});
+                break;
+            case STATE_OBJECT:
+                if (!m_object.name.empty()) {
+                    m_exe.m_targetObjects.push_back(std::move(m_object));
+                }
+                break;
+            default:
+                break;
+        }
+
+        m_stack.pop_back();
+
+        return true;
+    }
+
+    bool start_array(std::size_t) override
+    {
+        State state = STATE_SKIP;
+        State parent = m_stack.empty() ? STATE_SKIP : m_stack.back();
+        const char *message = nullptr;
+
+        if (parent == STATE_ROOT && m_key == s_symbolSection) {
+            state = STATE_SYMBOLS;
+            message = "Loading external symbols...\n";
+            m_found |= ConfigDatabase::HAS_SYMBOLS;
+        } else if (parent == STATE_ROOT && m_key == s_sectionsSection) {
+            state = STATE_SECTIONS;
+            message = "Loading section info...\n";
+            m_found |= ConfigDatabase::HAS_SECTIONS;
+        } else if (parent == STATE_ROOT && m_key == s_objectSection) {
+            state = STATE_OBJECTS;
+            message = "Loading objects...\n";
+            m_found |= ConfigDatabase::HAS_OBJECTS;
+        } else if (parent == STATE_OBJECT && m_key == "sections") {
+            state = STATE_OBJECT_SECTIONS;
+        }
+
+        if (message != nullptr && m_exe.m_verbose) {
+            printf("%s", message);
+        }
+
+        m_stack.push_back(state);
 
-    if (j.find(s_configSection) != j.end()) {
-        nlohmann::json &conf = j.at(s_configSection);
-        conf.at("codealign").get_to(m_codeAlignment);
-        conf.at("dataalign").get_to(m_dataAlignment);
-        conf.at("codepadding").get_to(m_codePad);
-        conf.at("datapadding").get_to(m_dataPad);
+        return true;
     }
 
-    if (j.find(s_symbolSection) != j.end()) {
-        load_symbols(j.at(s_symbolSection));
+    bool end_array() override
+    {
+        m_stack.pop_back();
+        return true;
     }
 
-    if (j.find(s_sectionsSection) != j.end()) {
-        load_sections(j.at(s_sectionsSection));
+    bool parse_error(std::size_t, const std::string &, const nlohmann::detail::exception &) override { return false; }
+
+    // ConfigDatabase::ContentFlags for the parts of the config read so far, the settings only count once all are set.
+    unsigned found() const { return m_settings == SETTINGS_ALL ? m_found | ConfigDatabase::HAS_CONFIG : m_found; }
+
+private:
+    bool in_entry() const
+    {
+        return !m_stack.empty()
+            && (m_stack.back() == STATE_SYMBOL || m_stack.back() == STATE_SECTION
+                || m_stack.back() == STATE_OBJECT_SECTION);
     }
 
-    if (j.find(s_objectSection) != j.end()) {
-        load_objects(j.at(s_objectSection));
+    bool number(uint64_t val)
+    {
+        if (m_stack.empty()) {
+            return true;
+        }
+
+        if (m_stack.back() == STATE_CONFIG) {
+            if (m_key == "codealign") {
+                m_exe.m_codeAlignment = static_cast<uint32_t>(val);
+                m_settings |= SETTING_CODE_ALIGN;
+            } else if (m_key == "dataalign") {
+                m_exe.m_dataAlignment = static_cast<uint32_t>(val);
+                m_settings |= SETTING_DATA_ALIGN;
+            } else if (m_key == "codepadding") {
+                m_exe.m_codePad = static_cast<uint8_t>(val);
+                m_settings |= SETTING_CODE_PAD;
+            } else if (m_key == "datapadding") {
+                m_exe.m_dataPad = static_cast<uint8_t>(val);
+                m_settings |= SETTING_DATA_PAD;
+            }
+        } else if (in_entry()) {
+            if (m_key == "address" || m_key == "start") {
+                m_address = val;
+            } else if (m_key == "size") {
+                m_size = val;
+            }
+        }
+
+        return true;
     }
+
+private:
+    Executable &m_exe;
+    std::vector<State> m_stack;
+    std::string m_key;
+    std::string m_name;
+    std::string m_type;
+    uint64_t m_address;
+    uint64_t m_size;
+    Object m_object; // Object being read, added once it ends if it has a name.
+    unsigned m_found;
+    unsigned m_settings;
+};
+
+void unassemblize::Executable::load_config(const char *file_name)
+{
+    if (m_verbose) {
+        printf("Loading config file '%s'...\n", file_name);
+    }
+
+    const unsigned all = ConfigDatabase::HAS_CONFIG | ConfigDatabase::HAS_SYMBOLS | ConfigDatabase::HAS_SECTIONS
+        | ConfigDatabase::HAS_OBJECTS;
+    unsigned found = ConfigDatabase::is_database(file_name) ? load_database(file_name) : load_json(file_name);
+    m_completeConfig = found == all ? file_name : "";
+    load_journal(file_name);
 }
 
 void unassemblize::Executable::save_config(const char *file_name)
@@ -199,6 +735,136 @@ void unassemblize::Executable::save_config(const char *file_name)
         printf("Saving config file '%s'...\n", file_name);
     }
 
+    // A loaded config that already has everything saving would fill in only needs the symbols found since loading,
+    // which are cheap to append to its journal. Anything else, such as --dumpsyms over an existing config that was
+    // never loaded or one missing some of its lists, goes through the full rewrite.
+    if (file_name == m_completeConfig && std::filesystem::exists(file_name)) {
+        append_journal(file_name);
+    } else {
+        write_config(file_name);
+    }
+}
+
+void unassemblize::Executable::compact_config(const char *file_name)
+{
+    if (m_verbose) {
+        printf("Compacting config file '%s'...\n", file_name);
+    }
+
+    write_config(file_name);
+}
+
+unsigned unassemblize::Executable::load_json(const char *file_name)
+{
+    MappedFile file;
+
+    if (!file.open(file_name)) {
+        return 0;
+    }
+
+    // Streamed so memory use doesn't grow with the size of the config.
+    ConfigHandler handler(*this);
+
+    if (!nlohmann::json::sax_parse(file.data(), file.data() + file.size(), &handler)) {
+        printf("Failed to parse config file '%s'.\n", file_name);
+        return 0;
+    }
+
+    return handler.found();
+}
+
+std::string unassemblize::Executable::journal_name(const char *file_name)
+{
+    return std::string(file_name) + ".journal";
+}
+
+void unassemblize::Executable::load_journal(const char *file_name)
+{
+    m_journalLoaded = true;
+    std::ifstream fs(journal_name(file_name));
+    std::string line;
+
+    // One symbol per line, a line cut short by an interrupted save is skipped.
+    while (std::getline(fs, line)) {
+        nlohmann::json entry = nlohmann::json::parse(line, nullptr, false);
+
+        if (entry.is_discarded() || !entry.is_object()) {
+            continue;
+        }
+
+        std::string name = entry.value("name", std::string());
+        uint64_t addr = entry.value("address", uint64_t(0));
+
+        if (!name.empty() && addr != 0) {
+            m_symbols.insert(addr, m_names.intern(name), entry.value("size", uint64_t(0)));
+            m_journalSymbols.insert(addr);
+        }
+    }
+
+    if (m_verbose && !m_journalSymbols.empty()) {
+        printf("Loaded %zu symbols from the config journal.\n", m_journalSymbols.size());
+    }
+}
+
+void unassemblize::Executable::append_journal(const char *file_name)
+{
+    if (m_newSymbols.empty()) {
+        return;
+    }
+
+    std::string journal = journal_name(file_name);
+    FILE *fp = fopen(journal.c_str(), "ab");
+
+    if (fp == nullptr) {
+        printf("Failed to open config journal '%s'.\n", journal.c_str());
+        return;
+    }
+
+    for (auto it = m_newSymbols.begin(); it != m_newSymbols.end(); ++it) {
+        Symbol sym = symbol(m_symbols.find(*it));
+        nlohmann::json entry = {{"name", name(sym.name)}, {"address", sym.value}, {"size", sym.size}};
+        fprintf(fp, "%s\n", entry.dump().c_str());
+        m_journalSymbols.insert(*it);
+    }
+
+    fclose(fp);
+    m_newSymbols.clear();
+
+    // Fold the journal back in once replaying it starts to cost a noticeable part of loading the config.
+    std::error_code ec;
+    uintmax_t config_size = std::filesystem::file_size(file_name, ec);
+    uintmax_t journal_size = std::filesystem::file_size(journal, ec);
+
+    if (!ec && journal_size > config_size / 4) {
+        compact_config(file_name);
+    }
+}
+
+void unassemblize::Executable::write_config(const char *file_name)
+{
+    // Everything in the journal has to go into the file before the journal can be removed.
+    if (!m_journalLoaded) {
+        load_journal(file_name);
+    }
+
+    m_newSymbols.insert(m_journalSymbols.begin(), m_journalSymbols.end());
+
+    if (ConfigDatabase::is_database(file_name)) {
+        save_database(file_name);
+    } else {
+        save_json(file_name);
+    }
+
+    std::error_code ec;
+    std::filesystem::remove(journal_name(file_name), ec);
+    m_journalSymbols.clear();
+    m_newSymbols.clear();
+    m_completeConfig = file_name;
+}
+
+void unassemblize::Executable::save_json(const char *file_name)
+{
+
     nlohmann::json j;
 
     // Parse the config file if it already exists and update it.
@@ -220,10 +886,12 @@ void unassemblize::Executable::save_config(const char *file_name)
     conf["codepadding"] = m_codePad;
     conf["datapadding"] = m_dataPad;
 
-    // Don't dump if we already have a sections for these.
+    // Don't dump if we already have a sections for these, but do add any symbols we found since loading.
     if (j.find(s_symbolSection) == j.end()) {
         j[s_symbolSection] = nlohmann::json();
         dump_symbols(j.at(s_symbolSection));
+    } else if (!m_newSymbols.empty()) {
+        update_symbols(j.at(s_symbolSection));
     }
 
     if (j.find(s_sectionsSection) == j.end()) {
@@ -240,35 +908,137 @@ void unassemblize::Executable::save_config(const char *file_name)
     fs << std::setw(4) << j << std::endl;
 }
 
-void unassemblize::Executable::load_symbols(nlohmann::json &js)
+unsigned unassemblize::Executable::load_database(const char *file_name)
 {
+    ConfigDatabase db;
+
+    if (!db.load(file_name)) {
+        return 0;
+    }
+
+    if (db.flags() & ConfigDatabase::HAS_CONFIG) {
+        m_codeAlignment = db.config().code_align;
+        m_dataAlignment = db.config().data_align;
+        m_codePad = db.config().code_pad;
+        m_dataPad = db.config().data_pad;
+    }
+
     if (m_verbose) {
-        printf("Loading external symbols...\n");
+        printf("Loading %zu external symbols...\n", db.symbol_count());
     }
 
-    for (auto it = js.begin(); it != js.end(); ++it) {
-        std::string name;
-        it->at("name").get_to(name);
+    m_symbols.reserve(db.symbol_count());
 
-        // Don't try and load an empty symbol.
-        if (!name.empty()) {
-            uint64_t size = 0;
-            uint64_t addr = 0;
-            it->at("address").get_to(addr);
+    for (size_t i = 0; i < db.symbol_count(); ++i) {
+        const ConfigDatabase::Symbol &sym = db.symbols()[i];
+        const char *name = db.string(sym.name);
 
-            if (addr == 0) {
-                continue;
+        // Only load symbols for addresses we don't have any symbol for yet, the index keeps the first.
+        if (*name != '\0' && sym.address != 0) {
+            m_symbols.insert(sym.address, m_names.intern(name), sym.size);
+        }
+    }
+
+    for (size_t i = 0; i < db.section_count(); ++i) {
+        const ConfigDatabase::Section &section = db.sections()[i];
+        const char *name = db.string(section.name);
+
+        if (*name != '\0') {
+            set_section_type(name, db.string(section.type));
+        }
+    }
+
+    for (size_t i = 0; i < db.object_count(); ++i) {
+        const ConfigDatabase::Object &obj = db.objects()[i];
+
+        if (*db.string(obj.name) == '\0') {
+            continue;
+        }
+
+        m_targetObjects.push_back({db.string(obj.name), std::list<ObjectSection>()});
+
+        for (uint32_t j = 0; j < obj.section_count; ++j) {
+            const ConfigDatabase::ObjectSection &sec = db.object_sections()[obj.first_section + j];
+            m_targetObjects.back().sections.push_back({db.string(sec.name), sec.start, sec.size});
+        }
+    }
+
+    return db.flags();
+}
+
+void unassemblize::Executable::save_database(const char *file_name)
+{
+    ConfigDatabase old;
+    unsigned old_flags = old.load(file_name) ? old.flags() : 0;
+    ConfigDatabase db;
+    db.set_config({m_codeAlignment, m_dataAlignment, m_codePad, m_dataPad});
+    db.set_flags(ConfigDatabase::HAS_SYMBOLS | ConfigDatabase::HAS_SECTIONS | ConfigDatabase::HAS_OBJECTS);
+
+    // Same rules as the JSON config, keep what is already there but add any symbols we found since loading.
+    if (old_flags & ConfigDatabase::HAS_SYMBOLS) {
+        std::set<uint64_t> pending = m_newSymbols;
+
+        for (size_t i = 0; i < old.symbol_count(); ++i) {
+            const ConfigDatabase::Symbol &sym = old.symbols()[i];
+            uint64_t size = sym.size;
+            auto found = pending.find(sym.address);
+
+            if (found != pending.end()) {
+                size = m_symbols.symbol_size(m_symbols.find(sym.address));
+                pending.erase(found);
             }
 
-            it->at("size").get_to(size);
+            db.add_symbol(old.string(sym.name), sym.address, size);
+        }
+
+        for (auto it = pending.begin(); it != pending.end(); ++it) {
+            Symbol sym = symbol(m_symbols.find(*it));
+            db.add_symbol(name(sym.name), sym.value, sym.size);
+        }
+    } else {
+        for (size_t i = 0; i < m_symbols.size(); ++i) {
+            db.add_symbol(name(m_symbols.name(i)), m_symbols.address(i), m_symbols.symbol_size(i));
+        }
+    }
+
+    if (old_flags & ConfigDatabase::HAS_SECTIONS) {
+        for (size_t i = 0; i < old.section_count(); ++i) {
+            db.add_section(old.string(old.sections()[i].name), old.string(old.sections()[i].type));
+        }
+    } else {
+        for (auto it = m_sections.begin(); it != m_sections.end(); ++it) {
+            db.add_section(it->first, it->second.type == SECTION_CODE ? "code" : "data");
+        }
+    }
+
+    if (old_flags & ConfigDatabase::HAS_OBJECTS) {
+        for (size_t i = 0; i < old.object_count(); ++i) {
+            const ConfigDatabase::Object &obj = old.objects()[i];
+            db.add_object(old.string(obj.name));
 
-            // Only load symbols for addresses we don't have any symbol for yet.
-            if (m_symbolMap.find(addr) == m_symbolMap.end()) {
-                m_loadedSymbols.push_back(name);
-                m_symbolMap.insert({addr, {m_loadedSymbols.back(), addr, size}});
+            for (uint32_t j = 0; j < obj.section_count; ++j) {
+                const ConfigDatabase::ObjectSection &sec = old.object_sections()[obj.first_section + j];
+                db.add_object_section(old.string(sec.name), sec.start, sec.size);
+            }
+        }
+    } else {
+        add_default_object();
+
+        for (auto it = m_targetObjects.begin(); it != m_targetObjects.end(); ++it) {
+            db.add_object(it->name);
+
+            for (auto sec = it->sections.begin(); sec != it->sections.end(); ++sec) {
+                db.add_object_section(sec->name, sec->start, sec->size);
             }
         }
     }
+
+    // The old file has to be unmapped before it can be replaced on some platforms.
+    old.close();
+
+    if (!db.save(file_name)) {
+        printf("Failed to save config database '%s'.\n", file_name);
+    }
 }
 
 void unassemblize::Executable::dump_symbols(nlohmann::json &js)
@@ -277,41 +1047,56 @@ void unassemblize::Executable::dump_symbols(nlohmann::json &js)
         printf("Saving symbols...\n");
     }
 
-    for (auto it = m_symbolMap.begin(); it != m_symbolMap.end(); ++it) {
-        js.push_back({{"name", it->second.name}, {"address", it->second.value}, {"size", it->second.size}});
+    for (size_t i = 0; i < m_symbols.size(); ++i) {
+        Symbol sym = symbol(i);
+        js.push_back({{"name", name(sym.name)}, {"address", sym.value}, {"size", sym.size}});
     }
 }
 
-void unassemblize::Executable::load_sections(nlohmann::json &js)
+void unassemblize::Executable::update_symbols(nlohmann::json &js)
 {
     if (m_verbose) {
-        printf("Loading section info...\n");
+        printf("Updating %zu symbols...\n", m_newSymbols.size());
     }
 
+    std::set<uint64_t> pending = m_newSymbols;
+
     for (auto it = js.begin(); it != js.end(); ++it) {
-        std::string name;
-        it->at("name").get_to(name);
+        uint64_t addr = 0;
+        it->at("address").get_to(addr);
+        auto found = pending.find(addr);
 
-        // Don't try and load an empty symbol.
-        if (!name.empty()) {
-            auto section = m_sections.find(name);
+        if (found != pending.end()) {
+            (*it)["size"] = m_symbols.symbol_size(m_symbols.find(addr));
+            pending.erase(found);
+        }
+    }
 
-            if (section == m_sections.end() && m_verbose) {
-                printf("Tried to load section info for section not present in this binary!\n");
-                printf("Section '%s' info was ignored.\n", name.c_str());
-            }
+    for (auto it = pending.begin(); it != pending.end(); ++it) {
+        Symbol sym = symbol(m_symbols.find(*it));
+        js.push_back({{"name", name(sym.name)}, {"address", sym.value}, {"size", sym.size}});
+    }
+}
 
-            std::string type;
-            it->at("type").get_to(type);
+void unassemblize::Executable::set_section_type(const std::string &name, const char *type)
+{
+    auto section = m_sections.find(name);
 
-            if (strcasecmp(type.c_str(), "code") == 0) {
-                section->second.type = SECTION_CODE;
-            } else if (strcasecmp(type.c_str(), "data") == 0) {
-                section->second.type = SECTION_DATA;
-            } else if (m_verbose) {
-                printf("Incorrect type specified for section '%s'.\n", name.c_str());
-            }
+    if (section == m_sections.end()) {
+        if (m_verbose) {
+            printf("Tried to load section info for section not present in this binary!\n");
+            printf("Section '%s' info was ignored.\n", name.c_str());
         }
+
+        return;
+    }
+
+    if (strcasecmp(type, "code") == 0) {
+        section->second.type = SECTION_CODE;
+    } else if (strcasecmp(type, "data") == 0) {
+        section->second.type = SECTION_DATA;
+    } else if (m_verbose) {
+        printf("Incorrect type specified for section '%s'.\n", name.c_str());
     }
 }
 
@@ -326,32 +1111,15 @@ void unassemblize::Executable::dump_sections(nlohmann::json &js)
     }
 }
 
-void unassemblize::Executable::load_objects(nlohmann::json &js)
+void unassemblize::Executable::add_default_object()
 {
-    if (m_verbose) {
-        printf("Loading objects...\n");
-    }
-
-    for (auto it = js.begin(); it != js.end(); ++it) {
-        std::string obj_name;
-        it->at("name").get_to(obj_name);
-
-        if (obj_name.empty()) {
-            continue;
-        }
-
-        m_targetObjects.push_back({obj_name, std::list<ObjectSection>()});
+    // Without any objects from a config the whole binary is treated as one object.
+    if (m_targetObjects.empty()) {
+        m_targetObjects.push_back({m_fileName, std::list<ObjectSection>()});
         auto &obj = m_targetObjects.back();
-        auto &sections = js.back().at("sections");
 
-        for (auto sec = sections.begin(); sec != sections.end(); ++sec) {
-            std::string name;
-            uint64_t start;
-            uint64_t size;
-            sec->at("name").get_to(name);
-            sec->at("start").get_to(start);
-            sec->at("size").get_to(size);
-            obj.sections.push_back({name, start, size});
+        for (auto it = m_sectionNames.begin(); it != m_sectionNames.end(); ++it) {
+            obj.sections.push_back({*it, 0, m_sections.at(*it).size});
         }
     }
 }
@@ -362,21 +1130,9 @@ void unassemblize::Executable::dump_objects(nlohmann::json &js)
         printf("Saving objects...\n");
     }
 
-    if (m_targetObjects.empty()) {
-        m_targetObjects.push_back(
-            {m_binary->name().substr(m_binary->name().find_last_of("/\\") + 1), std::list<ObjectSection>()});
-        auto &obj = m_targetObjects.back();
-
-        for (auto it = m_binary->sections().begin(); it != m_binary->sections().end(); ++it) {
-            if (it->name().empty() || it->size() == 0) {
-                continue;
-            }
+    add_default_object();
 
-            obj.sections.push_back({it->name(), 0, it->size()});
-        }
-    }
-
-    for (auto it = m_targetObjects.begin(); it != m_targetObjects.end(); ++it) {        
+    for (auto it = m_targetObjects.begin(); it != m_targetObjects.end(); ++it) {
         js.push_back({{"name", it->name}, {"sections", nlohmann::json()}});
         auto &sections = js.back().at("sections");
 
@@ -395,35 +1151,427 @@ void unassemblize::Executable::dissassemble_function(
     }
 
     if (m_outputFormat != OUTPUT_MASM) {
-        dissassemble_gas_func(output, section_name, start, end);
+        unassemblize::FunctionSetup setup(
+            m_outputFormat == OUTPUT_IGAS ? Function::FORMAT_IGAS : Function::FORMAT_AGAS, machine_mode());
+        FileSink sink(output);
+        begin_cache_run();
+        dissassemble_gas_func(sink, setup, section_name, start, end);
+        end_cache_run();
+    }
+}
+
+void unassemblize::Executable::dissassemble_all(FILE *output, unsigned jobs)
+{
+    // Abort if we can't output anywhere.
+    if (output == nullptr) {
+        return;
+    }
+
+    if (m_outputFormat == OUTPUT_MASM) {
+        return;
+    }
+
+    std::vector<FunctionRange> functions = function_ranges();
+    unassemblize::FunctionSetup setup(
+        m_outputFormat == OUTPUT_IGAS ? Function::FORMAT_IGAS : Function::FORMAT_AGAS, machine_mode());
+
+    if (m_verbose) {
+        printf("Dissassembling %zu functions...\n", functions.size());
+    }
+
+    FileSink sink(output);
+    begin_cache_run();
+
+    if (jobs == 1) {
+        for (auto it = functions.begin(); it != functions.end(); ++it) {
+            dissassemble_gas_func(sink, setup, it->section_name, it->start, it->end);
+        }
+
+        end_cache_run();
+        return;
+    }
+
+    // Functions finish in any order, hold on to each result until everything before it has been written so the
+    // output is identical to a serial run. Only this reordering needs a per function copy of the text, so functions
+    // are run in address ordered windows and only dealt largest first within each, a large function late in the
+    // image then can't hold back the text of everything dealt before it.
+    std::vector<std::string> results(functions.size());
+    std::vector<char> finished(functions.size(), false);
+    size_t next_output = 0;
+    std::mutex output_mutex;
+    auto run_function = [&](size_t index) {
+        const FunctionRange &range = functions[index];
+        std::string text;
+        {
+            StringSink text_sink(text);
+            dissassemble_gas_func(text_sink, setup, range.section_name, range.start, range.end);
+        }
+
+        std::lock_guard<std::mutex> lock(output_mutex);
+        results[index].swap(text);
+        finished[index] = true;
+
+        while (next_output < functions.size() && finished[next_output]) {
+            sink.write(results[next_output]);
+            std::string().swap(results[next_output]);
+            ++next_output;
+        }
+    };
+
+    ThreadPool pool(jobs);
+    std::vector<ThreadPool::Task> tasks;
+
+    if (m_verbose) {
+        printf("Using %u threads...\n", pool.thread_count());
+    }
+
+    for (size_t first = 0; first < functions.size();) {
+        uint64_t window = 0;
+        tasks.clear();
+
+        // Always take at least one function so one larger than the window still runs.
+        for (size_t i = first; i < functions.size() && (i == first || window < REORDER_WINDOW); ++i) {
+            uint64_t cost = functions[i].end - functions[i].start + 1;
+            tasks.push_back({cost, [&run_function, i]() { run_function(i); }});
+            window += cost;
+        }
+
+        pool.run(tasks);
+        first += tasks.size();
+    }
+
+    end_cache_run();
+}
+
+void unassemblize::Executable::dissassemble_objects(const char *output_dir, unsigned jobs)
+{
+    if (m_outputFormat == OUTPUT_MASM) {
+        return;
+    }
+
+    unassemblize::FunctionSetup setup(
+        m_outputFormat == OUTPUT_IGAS ? Function::FORMAT_IGAS : Function::FORMAT_AGAS, machine_mode());
+    std::vector<std::vector<FunctionRange>> object_functions;
+    std::vector<ThreadPool::Task> tasks;
+
+    // Reserved up front as the tasks hold references into it.
+    object_functions.reserve(m_targetObjects.size());
+
+    if (m_verbose) {
+        printf("Dissassembling %zu objects...\n", m_targetObjects.size());
+    }
+
+    for (auto it = m_targetObjects.begin(); it != m_targetObjects.end(); ++it) {
+        const Object &obj = *it;
+        object_functions.emplace_back();
+        std::vector<FunctionRange> &functions = object_functions.back();
+        uint64_t cost = 0;
+
+        for (auto sec = obj.sections.begin(); sec != obj.sections.end(); ++sec) {
+            auto section = m_sections.find(sec->name);
+
+            if (section == m_sections.end() || section->second.type != SECTION_CODE) {
+                continue;
+            }
+
+            // Object section ranges are relative to the start of the section they are in.
+            uint64_t start = section->second.address + sec->start;
+            uint64_t end = std::min(start + sec->size, section->second.address + section->second.size);
+            function_ranges(functions, section->first.c_str(), start, end, true);
+            cost += end > start ? end - start : 0;
+        }
+
+        // Each object writes to its own file so they need no coordination.
+        tasks.push_back({cost, [this, output_dir, &setup, &obj, &functions]() {
+                             dissassemble_object(output_dir, setup, obj, functions);
+                         }});
+    }
+
+    ThreadPool pool(jobs);
+    begin_cache_run();
+    pool.run(tasks);
+    end_cache_run();
+}
+
+void unassemblize::Executable::dissassemble_object(
+    const char *output_dir, const FunctionSetup &setup, const Object &obj, const std::vector<FunctionRange> &functions)
+{
+    // Object names are usually file names of the original object, swap whatever extension it had for .S.
+    std::filesystem::path path = std::filesystem::path(output_dir) / obj.name;
+    path.replace_extension(".S");
+
+    if (path.has_parent_path()) {
+        std::error_code ec;
+        std::filesystem::create_directories(path.parent_path(), ec);
+    }
+
+    FileSink sink(path.string().c_str());
+
+    if (!sink.is_open()) {
+        printf("Failed to open '%s' for writing.\n", path.string().c_str());
+        return;
+    }
+
+    if (m_verbose) {
+        printf("Writing object '%s'...\n", path.string().c_str());
+    }
+
+    sink.write(".intel_syntax noprefix\n\n");
+
+    for (auto it = functions.begin(); it != functions.end(); ++it) {
+        dissassemble_gas_func(sink, setup, it->section_name, it->start, it->end);
+    }
+}
+
+std::vector<unassemblize::Executable::FunctionRange> unassemblize::Executable::function_ranges() const
+{
+    std::vector<FunctionRange> functions;
+
+    for (auto sec = m_sections.begin(); sec != m_sections.end(); ++sec) {
+        if (sec->second.type != SECTION_CODE) {
+            continue;
+        }
+
+        function_ranges(functions, sec->first.c_str(), sec->second.address, sec->second.address + sec->second.size, false);
+    }
+
+    return functions;
+}
+
+void unassemblize::Executable::function_ranges(std::vector<FunctionRange> &functions, const char *section_name,
+    uint64_t start, uint64_t end, bool fill_gaps) const
+{
+    size_t count = m_symbols.size();
+    size_t pos = m_symbols.lower_bound(start);
+    uint64_t covered = start;
+
+    while (pos < count && m_symbols.address(pos) < end) {
+        uint64_t sym_start = m_symbols.address(pos);
+        uint64_t sym_size = m_symbols.symbol_size(pos);
+        uint64_t next_start = pos + 1 < count && m_symbols.address(pos + 1) < end ? m_symbols.address(pos + 1) : end;
+        uint64_t func_end = sym_size != 0 ? std::min(sym_start + sym_size, end) : next_start;
+
+        // Bytes no symbol covers are output as a function of their own so the whole range can be reassembled.
+        if (fill_gaps && covered < sym_start) {
+            functions.push_back({section_name, covered, sym_start - 1});
+        }
+
+        // Function end addresses are the last byte that belongs to the function.
+        if (func_end > sym_start) {
+            functions.push_back({section_name, sym_start, func_end - 1});
+            covered = func_end;
+        }
+
+        ++pos;
+    }
+
+    if (fill_gaps && covered < end) {
+        functions.push_back({section_name, covered, end - 1});
     }
 }
 
 void unassemblize::Executable::dissassemble_gas_func(
-    FILE *output, const char *section_name, uint64_t start, uint64_t end)
+    OutputSink &output, const FunctionSetup &setup, const char *section_name, uint64_t start, uint64_t end)
 {
     if (start != 0 && end != 0) {
+        uint32_t sym_id = get_symbol(start).name;
+        const char *sym = name(sym_id);
+        char hex_name[32];
+
+        if (sym_id == StringPool::empty) {
+            snprintf(hex_name, sizeof(hex_name), "sub_%" PRIx64, start);
+            sym = hex_name;
+        }
+
+        output.write(".globl ");
+        output.write(sym);
+        output.put('\n');
+        output.write(sym);
+        output.write(":\n", 2);
+
+        // Functions without a symbol only need their generated name interning for the dependency graph.
+        uint32_t caller = m_dependencyGraph != nullptr && sym_id == StringPool::empty ? intern_name(sym) : sym_id;
+
+        // Sections without file content have no bytes to key or check an entry by, so they are never cached.
+        const SectionInfo *section = section_info(section_name);
+
+        if (m_disassemblyCache != nullptr && section != nullptr && section->data != nullptr) {
+            dissassemble_cached(output, setup, section_name, start, end, caller);
+            return;
+        }
+
         unassemblize::Function func(*this, section_name, start, end);
-        if (m_outputFormat == OUTPUT_IGAS) {
-            func.disassemble(Function::FORMAT_IGAS);
-        } else {
-            func.disassemble(Function::FORMAT_AGAS);
-        }
-
-        const std::string &sym = get_symbol(start).name;
-
-        if (!sym.empty()) {
-            fprintf(output,
-                ".globl %s\n%s:\n%s",
-                sym.c_str(),
-                sym.c_str(),
-                func.dissassembly().c_str());
-        } else {
-            fprintf(output,
-                ".globl sub_%" PRIx64 "\nsub_%" PRIx64 ":\n%s",
-                start,
-                start,
-                func.dissassembly().c_str());
+        func.disassemble(setup, output);
+
+        if (m_dependencyGraph != nullptr) {
+            m_dependencyGraph->add_function(caller, func.dependencies());
+        }
+    }
+}
+
+void unassemblize::Executable::dissassemble_cached(OutputSink &output, const FunctionSetup &setup,
+    const char *section_name, uint64_t start, uint64_t end, uint32_t caller)
+{
+    uint64_t key = function_key(setup, section_name, start, end);
+    DisassemblyCache::Entry entry;
+
+    if (m_disassemblyCache->find(key, entry) && cache_entry_valid(entry)) {
+        m_disassemblyCache->keep(entry);
+        output.write(entry.text, entry.text_size);
+
+        if (m_dependencyGraph != nullptr) {
+            std::vector<Function::Dependency> deps;
+            size_t offset = 0;
+
+            while (offset + sizeof(uint32_t) < entry.deps_size) {
+                uint32_t flags;
+                memcpy(&flags, entry.deps + offset, sizeof(flags));
+                offset += sizeof(flags);
+                const char *dep = entry.deps + offset;
+                size_t length = strnlen(dep, entry.deps_size - offset);
+                deps.push_back({m_names.intern(dep, length), flags});
+                offset += length + 1;
+            }
+
+            m_dependencyGraph->add_function(caller, deps);
+        }
+
+        return;
+    }
+
+    unassemblize::Function func(*this, section_name, start, end);
+    std::string text;
+    {
+        StringSink text_sink(text);
+        func.set_record_lookups(true);
+        func.disassemble(setup, text_sink);
+    }
+    output.write(text);
+
+    // Record what each lookup found now so a later run can check its symbols still give the same answers.
+    std::vector<Function::SymbolLookup> func_lookups = func.lookups();
+    auto lookup_less = [](const Function::SymbolLookup &a, const Function::SymbolLookup &b) {
+        return a.address != b.address ? a.address < b.address : a.nearest < b.nearest;
+    };
+    std::sort(func_lookups.begin(), func_lookups.end(), lookup_less);
+    std::vector<DisassemblyCache::Lookup> lookups;
+    lookups.reserve(func_lookups.size() + 1);
+
+    for (size_t i = 0; i < func_lookups.size(); ++i) {
+        const Function::SymbolLookup &lookup = func_lookups[i];
+
+        if (i != 0 && lookup.address == func_lookups[i - 1].address && lookup.nearest == func_lookups[i - 1].nearest) {
+            continue;
+        }
+
+        Symbol sym = lookup.nearest ? get_nearest_symbol(lookup.address) : get_symbol(lookup.address);
+        uint32_t type = lookup.nearest ? DisassemblyCache::LOOKUP_NEAREST_SYMBOL : DisassemblyCache::LOOKUP_SYMBOL;
+        lookups.push_back({lookup.address, sym.value, hash_bytes(name(sym.name), name_length(sym.name)), type, 0});
+    }
+
+    const SectionInfo *section = func.section_info();
+
+    if (section != nullptr && section->data != nullptr && func.read_end() > end + 1) {
+        uint64_t tail_end = std::min(func.read_end(), section->address + section->size);
+        const uint8_t *tail = section->data + (end + 1 - section->address);
+        lookups.push_back({end + 1, tail_end, hash_bytes(tail, tail_end - end - 1), DisassemblyCache::LOOKUP_BYTES, 0});
+    }
+
+    std::string deps;
+
+    for (auto it = func.dependencies().begin(); it != func.dependencies().end(); ++it) {
+        deps.append(reinterpret_cast<const char *>(&it->flags), sizeof(it->flags));
+        deps.append(name(it->name), name_length(it->name) + 1);
+    }
+
+    m_disassemblyCache->add(key, lookups, deps, text);
+
+    if (m_dependencyGraph != nullptr) {
+        m_dependencyGraph->add_function(caller, func.dependencies());
+    }
+}
+
+uint64_t unassemblize::Executable::function_key(
+    const FunctionSetup &setup, const char *section_name, uint64_t start, uint64_t end) const
+{
+    struct
+    {
+        uint64_t layout;
+        uint64_t start;
+        uint64_t end;
+        uint32_t format;
+        uint32_t mode;
+    } params = {m_layoutHash, start, end, uint32_t(setup.format()), uint32_t(setup.machine_mode())};
+
+    uint64_t seed = hash_bytes(&params, sizeof(params), hash_bytes(section_name, strlen(section_name)));
+    const SectionInfo *section = section_info(section_name);
+
+    if (section == nullptr || section->data == nullptr || start < section->address
+        || start >= section->address + section->size || end < start) {
+        return seed;
+    }
+
+    // Bytes decoding reads past the end are checked through the entry's lookups instead.
+    uint64_t offset = start - section->address;
+
+    return hash_bytes(section->data + offset, std::min(end - start + 1, section->size - offset), seed);
+}
+
+bool unassemblize::Executable::cache_entry_valid(const DisassemblyCache::Entry &entry) const
+{
+    for (size_t i = 0; i < entry.lookup_count; ++i) {
+        const DisassemblyCache::Lookup &lookup = entry.lookups[i];
+
+        if (lookup.type == DisassemblyCache::LOOKUP_BYTES) {
+            const Region *region = classify(lookup.address);
+            const SectionInfo *section = region != nullptr ? region->section : nullptr;
+
+            if (section == nullptr || section->data == nullptr || lookup.value > section->address + section->size
+                || lookup.value < lookup.address) {
+                return false;
+            }
+
+            const uint8_t *bytes = section->data + (lookup.address - section->address);
+
+            if (hash_bytes(bytes, lookup.value - lookup.address) != lookup.hash) {
+                return false;
+            }
+
+            continue;
         }
+
+        Symbol sym = lookup.type == DisassemblyCache::LOOKUP_NEAREST_SYMBOL ? get_nearest_symbol(lookup.address)
+                                                                            : get_symbol(lookup.address);
+
+        if (sym.value != lookup.value || hash_bytes(name(sym.name), name_length(sym.name)) != lookup.hash) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void unassemblize::Executable::begin_cache_run()
+{
+    if (m_disassemblyCache == nullptr) {
+        return;
+    }
+
+    // Section types come from the config, so the layout is hashed when dissassembly starts rather than on loading.
+    m_layoutHash = hash_bytes(&m_imageBase, sizeof(m_imageBase));
+
+    for (auto it = m_sections.begin(); it != m_sections.end(); ++it) {
+        uint64_t info[3] = {it->second.address, it->second.size, uint64_t(it->second.type)};
+        m_layoutHash = hash_bytes(it->first.data(), it->first.size(), m_layoutHash);
+        m_layoutHash = hash_bytes(info, sizeof(info), m_layoutHash);
+    }
+
+    m_disassemblyCache->load(m_disassemblyCacheFile.c_str());
+}
+
+void unassemblize::Executable::end_cache_run()
+{
+    if (m_disassemblyCache != nullptr && !m_disassemblyCache->save(m_disassemblyCacheFile.c_str())) {
+        printf("Failed to save dissassembly cache '%s'.\n", m_disassemblyCacheFile.c_str());
     }
 }
@@ -12,20 +12,26 @@
  */
 #pragma once
 
+#include "disasmcache.h"
+#include "mappedfile.h"
+#include "stringpool.h"
+#include "symbolindex.h"
+#include <Zydis/Zydis.h>
 #include <list>
 #include <map>
 #include <memory>
+#include <set>
 #include <nlohmann/json_fwd.hpp>
 #include <stdio.h>
 #include <string>
-
-namespace LIEF
-{
-class Binary;
-}
+#include <vector>
 
 namespace unassemblize
 {
+class DependencyGraph;
+class FunctionSetup;
+class OutputSink;
+
 class Executable
 {
 public:
@@ -49,10 +55,17 @@ public:
         SectionTypes type;
     };
 
+    struct Region
+    {
+        uint64_t start;
+        uint64_t end; // One past the last address.
+        const SectionInfo *section; // Null for parts of the image between sections.
+    };
+
     struct Symbol
     {  
-        Symbol(std::string &_name, uint64_t _value, uint64_t _size) : name(_name), value(_value), size(_size) {}
-        std::string &name;
+        Symbol(uint32_t _name, uint64_t _value, uint64_t _size) : name(_name), value(_value), size(_size) {}
+        uint32_t name; // Id in the executable's name pool.
         uint64_t value;
         uint64_t size;
     };
@@ -71,61 +84,169 @@ public:
     };
 
 public:
-    Executable(const char *file_name, OutputFormats format = OUTPUT_IGAS, bool verbose = false);
+    /**
+     * Loads an executable, if a cache directory is given the parsed sections and symbols are saved there as a
+     * snapshot keyed by a hash of the file contents and later runs over the same file load that instead of parsing.
+     * Dissassembled functions are cached there too, see DisassemblyCache.
+     */
+    Executable(
+        const char *file_name, OutputFormats format = OUTPUT_IGAS, bool verbose = false, const char *cache_dir = nullptr);
     const std::map<std::string, SectionInfo> &sections() const { return m_sections; }
+    const SectionInfo *section_info(const char *name) const;
     const uint8_t *section_data(const char *name) const;
     uint64_t section_address(const char *name) const;
     uint64_t section_size(const char *name) const;
-    uint64_t base_address() const;
+    uint64_t base_address() const { return m_imageBase; }
+    uint32_t address_width() const { return m_addressWidth; } // 64 for PE32+ and ELF64 binaries, otherwise 32.
+    ZydisMachineMode machine_mode() const
+    {
+        return m_addressWidth == 64 ? ZYDIS_MACHINE_MODE_LONG_64 : ZYDIS_MACHINE_MODE_LEGACY_32;
+    }
     uint64_t end_address() const { return m_endAddress; };
-    const Symbol &get_symbol(uint64_t addr) const;
-    const Symbol &get_nearest_symbol(uint64_t addr) const;
-    void add_symbol(const char *sym, uint64_t addr);
+    uint64_t entry_point() const { return m_entryPoint; }
+    /**
+     * Region of the image an address falls in, nullptr if it is outside the image.
+     */
+    const Region *classify(uint64_t addr) const;
+    const SymbolIndex &symbols() const { return m_symbols; }
+    Symbol symbol(size_t pos) const; // Symbol at a position in the index.
+    const char *name(uint32_t id) const { return m_names.c_str(id); }
+    uint32_t name_length(uint32_t id) const { return m_names.length(id); }
+    uint32_t intern_name(const std::string &name) { return m_names.intern(name); }
+    uint32_t intern_name(const char *name) { return m_names.intern(name); }
+    Symbol get_symbol(uint64_t addr) const;
+    /**
+     * Symbol at or before an address, if the symbol has a size the address must be inside it.
+     */
+    Symbol get_nearest_symbol(uint64_t addr) const;
+    /**
+     * Adds a symbol if the address doesn't have one yet, or sets the size of an existing one that has no size.
+     * Symbols added this way are written back to the config by save_config.
+     */
+    void add_symbol(const char *sym, uint64_t addr, uint64_t size = 0);
+    /**
+     * Config files ending in .db are read and written as a ConfigDatabase, anything else as JSON.
+     * Saving over the loaded config, when it already has every setting and list, appends the symbols found since
+     * loading to a journal next to it, which loading replays and which is folded back into the config by
+     * compact_config, or by saving once it grows large. Any other save rewrites the config.
+     */
     void load_config(const char *file_name);
     void save_config(const char *file_name);
+    void compact_config(const char *file_name);
     /**
      * Dissassembles a range of bytes and outputs the format as though it were a single function.
      * Addresses should be the absolute addresses when the binary is loaded at its preferred base address.
      */
     void dissassemble_function(FILE *output, const char *section_name, uint64_t start, uint64_t end);
+    /**
+     * Dissassembles every symbol found in a code section as a function, parsing the binary only once.
+     * Each function ends where its symbol size says it does, or at the next symbol if it has no size.
+     * Functions are spread over the given number of threads, 0 for one per hardware thread, with the output in the
+     * same order as a single threaded run.
+     */
+    void dissassemble_all(FILE *output, unsigned jobs = 1);
+    /**
+     * Dissassembles the code section ranges of each object from the config into its own .S file in output_dir.
+     * Objects are spread over the given number of threads, 0 for one per hardware thread.
+     */
+    void dissassemble_objects(const char *output_dir, unsigned jobs = 1);
+    /**
+     * Graph every function dissassembled from now on is added to along with what it references, nullptr for none.
+     */
+    void set_dependency_graph(DependencyGraph *graph) { m_dependencyGraph = graph; }
 
 private:
-    void dissassemble_gas_func(FILE *output, const char *section_name, uint64_t start, uint64_t end);
+    class ConfigHandler;
+
+    struct FunctionRange
+    {
+        const char *section_name;
+        uint64_t start;
+        uint64_t end;
+    };
+
+    void dissassemble_gas_func(
+        OutputSink &output, const FunctionSetup &setup, const char *section_name, uint64_t start, uint64_t end);
+    /**
+     * Outputs a function from the dissassembly cache if it has a valid entry for it, otherwise dissassembles it and
+     * adds it to the cache. Caller is the function's name id for the dependency graph.
+     */
+    void dissassemble_cached(OutputSink &output, const FunctionSetup &setup, const char *section_name, uint64_t start,
+        uint64_t end, uint32_t caller);
+    uint64_t function_key(const FunctionSetup &setup, const char *section_name, uint64_t start, uint64_t end) const;
+    bool cache_entry_valid(const DisassemblyCache::Entry &entry) const;
+    void begin_cache_run();
+    void end_cache_run();
+    void dissassemble_object(const char *output_dir, const FunctionSetup &setup, const Object &obj,
+        const std::vector<FunctionRange> &functions);
+    std::vector<FunctionRange> function_ranges() const;
+    void function_ranges(std::vector<FunctionRange> &functions, const char *section_name, uint64_t start, uint64_t end,
+        bool fill_gaps) const;
 
-    void load_symbols(nlohmann::json &js);
     /**
      * Dump symbols from the executable to a config file.
      */
     void dump_symbols(nlohmann::json &js);
-    void load_sections(nlohmann::json &js);
+    /**
+     * Add symbols added since loading to existing config symbols.
+     */
+    void update_symbols(nlohmann::json &js);
+    void load_binary(const char *file_name);
+    bool load_snapshot(const char *file_name, uint64_t hash);
+    void save_snapshot(const char *file_name, uint64_t hash);
+    void build_regions();
+    unsigned load_json(const char *file_name); // Returns the ConfigDatabase::ContentFlags the config has.
+    void save_json(const char *file_name);
+    static std::string journal_name(const char *file_name);
+    void load_journal(const char *file_name);
+    void append_journal(const char *file_name);
+    void write_config(const char *file_name);
+    unsigned load_database(const char *file_name); // Returns the ConfigDatabase::ContentFlags the database has.
+    void save_database(const char *file_name);
+    void set_section_type(const std::string &name, const char *type);
     /**
      * Dump sections from the executable to a config file.
      */
     void dump_sections(nlohmann::json &js);
-    void load_objects(nlohmann::json &js);
     /**
      * Dump sections from the executable to a config file.
      */
     void dump_objects(nlohmann::json &js);
+    void add_default_object();
 
 private:
-    std::unique_ptr<LIEF::Binary> m_binary;
+    MappedFile m_file;
+    std::string m_fileName; // Name of the input without its path.
     std::map<std::string, SectionInfo> m_sections;
-    std::map<uint64_t, Symbol> m_symbolMap;
-    std::list<std::string> m_loadedSymbols;
+    std::vector<std::string> m_sectionNames; // Section names in the order the binary lists them.
+    std::vector<Region> m_regions; // Sorted and contiguous from the image base to the end address.
+    SymbolIndex m_symbols;
+    StringPool m_names; // Symbol and dependency names.
+    std::set<uint64_t> m_newSymbols; // Symbols added or changed by add_symbol that the config doesn't have yet.
+    std::set<uint64_t> m_journalSymbols; // Symbols in the config's journal that the file itself doesn't have yet.
     std::list<Object> m_targetObjects;
+    DependencyGraph *m_dependencyGraph;
+    std::unique_ptr<DisassemblyCache> m_disassemblyCache; // Only created when the constructor is given a cache directory.
+    std::string m_disassemblyCacheFile;
+    uint64_t m_layoutHash; // Hash of the section layout, part of every cache key.
     OutputFormats m_outputFormat;
+    uint64_t m_imageBase;
+    uint32_t m_addressWidth;
     uint64_t m_endAddress;
+    uint64_t m_entryPoint;
     uint32_t m_codeAlignment;
     uint32_t m_dataAlignment;
     uint8_t m_codePad;
     uint8_t m_dataPad;
     bool m_verbose;
     bool m_addBase;
+    bool m_journalLoaded;
+    std::string m_completeConfig; // Config loaded with every setting and list saving fills in, empty if none was.
 
     static const char s_symbolSection[];
     static const char s_sectionsSection[];
     static const char s_configSection[];
     static const char s_objectSection[];
+    static const char s_snapshotMagic[];
 };
 }
@@ -1,640 +1,804 @@
 #include "function.h"
 #include <Zydis/Zydis.h>
+#include <algorithm>
 #include <inttypes.h>
 #include <string.h>
-#include <sstream>
 #include <Zycore/Format.h>
 
 namespace
 {
+// Space the formatter is given for a single instruction's text.
+const size_t INSTRUCTION_TEXT_LENGTH = 96;
+
+// Limits on how far back to look for a jump table's bound and how many entries to accept.
+const size_t MAX_SWITCH_SCAN = 8;
+const uint32_t MAX_TABLE_ENTRIES = 4096;
+
 uint32_t get_le32(const uint8_t *data)
 {
     return (data[3] << 24) | (data[2] << 16) | (data[1] << 8) | data[0];
 }
 
-// Copy of the disassmble function without any formatting.
-static ZyanStatus UnasmDisassembleNoFormat(ZydisMachineMode machine_mode, ZyanU64 runtime_address, const void *buffer,
-    ZyanUSize length, ZydisDisassembledInstruction *instruction)
+uint64_t get_le64(const uint8_t *data)
 {
-    if (!buffer || !instruction) {
-        return ZYAN_STATUS_INVALID_ARGUMENT;
+    return (uint64_t(get_le32(data + 4)) << 32) | get_le32(data);
+}
+
+// Symbols in code sections are taken to be code references, anything else data.
+uint32_t dependency_flags(const unassemblize::Executable::Region *region)
+{
+    return region != nullptr && region->section != nullptr && region->section->type == unassemblize::Executable::SECTION_CODE
+        ? unassemblize::Function::DEPENDENCY_CODE
+        : unassemblize::Function::DEPENDENCY_DATA;
+}
+
+// How an operand address was named. Only SYMBOL_NAME refers to a symbol, the others are generated from the address.
+enum SymbolKinds
+{
+    SYMBOL_NONE,
+    SYMBOL_NAME,
+    SYMBOL_LABEL,
+    SYMBOL_SUB,
+    SYMBOL_OFF,
+    SYMBOL_UNK,
+};
+
+struct ResolvedSymbol
+{
+    SymbolKinds kind;
+    uint32_t name;
+    uint64_t offset; // Distance past the symbol for names found by nearest lookups.
+};
+
+/**
+ * The one place operand addresses get their names, with a single symbol lookup. Nearest lookups name addresses inside
+ * a symbol as an offset from it, addresses in another section than the function get other_type as generated name.
+ */
+ResolvedSymbol resolve_symbol(
+    unassemblize::Function &func, uint64_t address, bool nearest, unassemblize::Function::ReferenceTypes other_type)
+{
+    const unassemblize::Executable::Region *region = func.executable().classify(address);
+    unassemblize::Executable::Symbol symbol = nearest ? func.find_nearest_symbol(address) : func.find_symbol(address);
+
+    bool named = symbol.name != unassemblize::StringPool::empty;
+
+    if (named && symbol.value == address) {
+        func.add_dependency(symbol.name, dependency_flags(region));
+        return {SYMBOL_NAME, symbol.name, 0};
     }
 
-    memset(instruction, 0, sizeof(*instruction));
-    instruction->runtime_address = runtime_address;
+    if (func.labels().contains(address)) {
+        return {SYMBOL_LABEL, unassemblize::StringPool::empty, 0};
+    }
 
-    // Derive the stack width from the address width.
-    ZydisStackWidth stack_width;
-    switch (machine_mode) {
-        case ZYDIS_MACHINE_MODE_LONG_64:
-            stack_width = ZYDIS_STACK_WIDTH_64;
-            break;
-        case ZYDIS_MACHINE_MODE_LONG_COMPAT_32:
-        case ZYDIS_MACHINE_MODE_LEGACY_32:
-            stack_width = ZYDIS_STACK_WIDTH_32;
-            break;
-        case ZYDIS_MACHINE_MODE_LONG_COMPAT_16:
-        case ZYDIS_MACHINE_MODE_LEGACY_16:
-        case ZYDIS_MACHINE_MODE_REAL_16:
-            stack_width = ZYDIS_STACK_WIDTH_16;
-            break;
-        default:
-            return ZYAN_STATUS_INVALID_ARGUMENT;
+    if (region == nullptr) {
+        return {SYMBOL_NONE, unassemblize::StringPool::empty, 0};
     }
 
-    ZydisDecoder decoder;
-    ZYAN_CHECK(ZydisDecoderInit(&decoder, machine_mode, stack_width));
+    if (named) {
+        func.add_dependency(symbol.name, dependency_flags(region));
+        return {SYMBOL_NAME, symbol.name, address - symbol.value};
+    }
 
-    ZydisDecoderContext ctx;
-    ZYAN_CHECK(ZydisDecoderDecodeInstruction(&decoder, &ctx, buffer, length, &instruction->info));
-    ZYAN_CHECK(ZydisDecoderDecodeOperands(
-        &decoder, &ctx, &instruction->info, instruction->operands, instruction->info.operand_count));
+    // Probably a function if the address is in the current section, data if it is in another one.
+    unassemblize::Function::ReferenceTypes type =
+        region->section == func.section_info() ? unassemblize::Function::REFERENCE_SUB : other_type;
+    func.add_reference(address, type);
 
-    return ZYAN_STATUS_SUCCESS;
+    return {SymbolKinds(SYMBOL_SUB + type), unassemblize::StringPool::empty, 0};
 }
 
-ZydisFormatterFunc default_print_address_absolute;
+ZyanStatus append_symbol(ZydisFormatterBuffer *buffer, const unassemblize::Function &func, const ResolvedSymbol &symbol,
+    uint64_t address, const char *prefix, const char *suffix)
+{
+    static const char *const generated[] = {"", "", "loc_", "sub_", "off_", "unk_"};
+    ZYAN_CHECK(ZydisFormatterBufferAppend(buffer, ZYDIS_TOKEN_SYMBOL));
+    ZyanString *string;
+    ZYAN_CHECK(ZydisFormatterBufferGetString(buffer, &string));
 
-static ZyanStatus UnasmFormatterPrintAddressAbsolute(
-    const ZydisFormatter *formatter, ZydisFormatterBuffer *buffer, ZydisFormatterContext *context)
+    if (symbol.kind != SYMBOL_NAME) {
+        return ZyanStringAppendFormat(string, "%s%s%" PRIx64 "%s", prefix, generated[symbol.kind], address, suffix);
+    }
+
+    const char *name = func.executable().name(symbol.name);
+
+    if (symbol.offset != 0) {
+        return ZyanStringAppendFormat(string, "%s%s+0x%" PRIx64 "%s", prefix, name, symbol.offset, suffix);
+    }
+
+    return ZyanStringAppendFormat(string, "%s%s%s", prefix, name, suffix);
+}
+
+// Operand kinds the formatter hooks are instantiated for. Each says where its address comes from, the text around the
+// name, whether addresses inside a symbol are named relative to it and which formatter function to fall back on.
+struct AddressOperand
 {
-    unassemblize::Function *func = static_cast<unassemblize::Function *>(context->user_data);
-    uint64_t address;
-    ZYAN_CHECK(ZydisCalcAbsoluteAddress(context->instruction, context->operand, context->runtime_address, &address));
-    char hex_buff[32];
-    const unassemblize::Executable::Symbol &symbol = func->executable().get_symbol(address);
+    static ZyanStatus address(const ZydisFormatterContext *context, uint64_t &address, const char *&prefix)
+    {
+        prefix = "";
+        return ZydisCalcAbsoluteAddress(context->instruction, context->operand, context->runtime_address, &address);
+    }
 
-    if (!symbol.name.empty()) {
-        ZYAN_CHECK(ZydisFormatterBufferAppend(buffer, ZYDIS_TOKEN_SYMBOL));
-        ZyanString *string;
-        ZYAN_CHECK(ZydisFormatterBufferGetString(buffer, &string));
-        auto it = func->labels().find(address);
-        return ZyanStringAppendFormat(string, "%s", symbol.name.c_str());
-    } else if (address >= func->section_address() && address <= func->section_end()) {
-        // Probably a function if the address is in the current section.
-        ZYAN_CHECK(ZydisFormatterBufferAppend(buffer, ZYDIS_TOKEN_SYMBOL));
-        ZyanString *string;
-        ZYAN_CHECK(ZydisFormatterBufferGetString(buffer, &string));
-        const unassemblize::Executable::Symbol &symbol = func->executable().get_symbol(address);
+    static ZyanStatus begin(const ZydisFormatter *, ZydisFormatterBuffer *, ZydisFormatterContext *)
+    {
+        return ZYAN_STATUS_SUCCESS;
+    }
 
-        if (!symbol.name.empty()) {
-            func->add_dependency(symbol.name);
-            return ZyanStringAppendFormat(string, "%s", symbol.name.c_str());
-        }
+    static constexpr const char *suffix = "";
+    static constexpr bool nearest = false;
+    static constexpr unassemblize::Function::ReferenceTypes other_type = unassemblize::Function::REFERENCE_OFF;
+};
 
-        snprintf(hex_buff, sizeof(hex_buff), "sub_%" PRIx64, address);
-        func->add_dependency(hex_buff);
+struct AbsoluteOperand : AddressOperand
+{
+    static constexpr ZydisFormatterFunc unassemblize::FunctionSetup::*fallback =
+        &unassemblize::FunctionSetup::default_print_address_absolute;
+};
 
-        return ZyanStringAppendFormat(string, "sub_%" PRIx64, address);
-    } else if (address >= func->executable().base_address() && address <= func->executable().end_address()) {
-        // Data is in another section?
-        ZYAN_CHECK(ZydisFormatterBufferAppend(buffer, ZYDIS_TOKEN_SYMBOL));
-        ZyanString *string;
-        ZYAN_CHECK(ZydisFormatterBufferGetString(buffer, &string));
-        const unassemblize::Executable::Symbol &symbol = func->executable().get_symbol(address);
+struct RelativeOperand : AddressOperand
+{
+    static constexpr ZydisFormatterFunc unassemblize::FunctionSetup::*fallback =
+        &unassemblize::FunctionSetup::default_print_address_relative;
+};
 
-        if (!symbol.name.empty()) {
-            func->add_dependency(symbol.name);
-            return ZyanStringAppendFormat(string, "%s", symbol.name.c_str());
-        }
+struct ImmediateOperand : AddressOperand
+{
+    static ZyanStatus address(const ZydisFormatterContext *context, uint64_t &address, const char *&prefix)
+    {
+        address = context->operand->imm.value.u;
+        prefix = "offset ";
+        return ZYAN_STATUS_SUCCESS;
+    }
 
-        snprintf(hex_buff, sizeof(hex_buff), "off_%" PRIx64, address);
-        func->add_dependency(hex_buff);
+    static constexpr ZydisFormatterFunc unassemblize::FunctionSetup::*fallback =
+        &unassemblize::FunctionSetup::default_print_immediate;
+};
 
-        return ZyanStringAppendFormat(string, "off_%" PRIx64, address);
+struct DisplacementOperand : AddressOperand
+{
+    static ZyanStatus address(const ZydisFormatterContext *context, uint64_t &address, const char *&prefix)
+    {
+        address = context->operand->mem.disp.value;
+        prefix = "+";
+        return ZYAN_STATUS_SUCCESS;
     }
 
-    return default_print_address_absolute(formatter, buffer, context);
-}
+    static constexpr bool nearest = true;
+    static constexpr ZydisFormatterFunc unassemblize::FunctionSetup::*fallback =
+        &unassemblize::FunctionSetup::default_print_displacement;
+};
 
-ZydisFormatterFunc default_print_address_relative;
+struct PointerOperand : AddressOperand
+{
+    static ZyanStatus address(const ZydisFormatterContext *context, uint64_t &address, const char *&prefix)
+    {
+        address = context->operand->ptr.offset;
+        prefix = "";
+        return ZYAN_STATUS_SUCCESS;
+    }
+
+    static constexpr unassemblize::Function::ReferenceTypes other_type = unassemblize::Function::REFERENCE_UNK;
+    static constexpr ZydisFormatterFunc unassemblize::FunctionSetup::*fallback =
+        &unassemblize::FunctionSetup::default_format_operand_ptr;
+};
+
+struct MemoryOperand : PointerOperand
+{
+    static ZyanStatus address(const ZydisFormatterContext *context, uint64_t &address, const char *&prefix)
+    {
+        const ZydisDecodedOperand *operand = context->operand;
+        address = operand->mem.disp.value;
+        prefix = "[";
+
+        // Instruction pointer relative operands are named by the address they resolve to but keep their base register.
+        if (operand->mem.base == ZYDIS_REGISTER_RIP || operand->mem.base == ZYDIS_REGISTER_EIP) {
+            prefix = operand->mem.base == ZYDIS_REGISTER_RIP ? "[rip+" : "[eip+";
+            return ZydisCalcAbsoluteAddress(context->instruction, operand, context->runtime_address, &address);
+        }
+
+        return ZYAN_STATUS_SUCCESS;
+    }
+
+    static ZyanStatus begin(const ZydisFormatter *formatter, ZydisFormatterBuffer *buffer, ZydisFormatterContext *context)
+    {
+        if ((context->operand->mem.type == ZYDIS_MEMOP_TYPE_MEM) || (context->operand->mem.type == ZYDIS_MEMOP_TYPE_VSIB)) {
+            ZYAN_CHECK(formatter->func_print_typecast(formatter, buffer, context));
+        }
+
+        return formatter->func_print_segment(formatter, buffer, context);
+    }
 
-static ZyanStatus UnasmFormatterPrintAddressRelative(
+    static constexpr const char *suffix = "]";
+    static constexpr ZydisFormatterFunc unassemblize::FunctionSetup::*fallback =
+        &unassemblize::FunctionSetup::default_format_operand_mem;
+};
+
+template<typename Operand>
+ZyanStatus UnasmFormatterPrintOperand(
     const ZydisFormatter *formatter, ZydisFormatterBuffer *buffer, ZydisFormatterContext *context)
 {
     unassemblize::Function *func = static_cast<unassemblize::Function *>(context->user_data);
     uint64_t address;
-    ZYAN_CHECK(ZydisCalcAbsoluteAddress(context->instruction, context->operand, context->runtime_address, &address));
-    char hex_buff[32];
-    const unassemblize::Executable::Symbol &symbol = func->executable().get_symbol(address);
+    const char *prefix;
+    ZYAN_CHECK(Operand::address(context, address, prefix));
+    ResolvedSymbol symbol = resolve_symbol(*func, address, Operand::nearest, Operand::other_type);
+    ZYAN_CHECK(Operand::begin(formatter, buffer, context));
 
-    if (!symbol.name.empty()) {
-        ZYAN_CHECK(ZydisFormatterBufferAppend(buffer, ZYDIS_TOKEN_SYMBOL));
-        ZyanString *string;
-        ZYAN_CHECK(ZydisFormatterBufferGetString(buffer, &string));
-        auto it = func->labels().find(address);
-        return ZyanStringAppendFormat(string, "%s", symbol.name.c_str());
-    } else if (address >= func->section_address() && address <= func->section_end()) {
-        // Probably a function if the address is in the current section.
-        ZYAN_CHECK(ZydisFormatterBufferAppend(buffer, ZYDIS_TOKEN_SYMBOL));
-        ZyanString *string;
-        ZYAN_CHECK(ZydisFormatterBufferGetString(buffer, &string));
-        const unassemblize::Executable::Symbol &symbol = func->executable().get_symbol(address);
+    if (symbol.kind == SYMBOL_NONE) {
+        return (func->setup().*Operand::fallback)(formatter, buffer, context);
+    }
 
-        if (!symbol.name.empty()) {
-            func->add_dependency(symbol.name);
-            return ZyanStringAppendFormat(string, "%s", symbol.name.c_str());
-        }
+    return append_symbol(buffer, *func, symbol, address, prefix, Operand::suffix);
+}
 
-        snprintf(hex_buff, sizeof(hex_buff), "sub_%" PRIx64, address);
-        func->add_dependency(hex_buff);
+static ZyanStatus UnasmFormatterFormatPrintRegister(
+    const ZydisFormatter *formatter, ZydisFormatterBuffer *buffer, ZydisFormatterContext *context, ZydisRegister reg)
+{
+    // Copied from internal FormatterBase.h
+#define ZYDIS_BUFFER_APPEND_TOKEN(buffer, type) \
+    if ((buffer)->is_token_list) { \
+        ZYAN_CHECK(ZydisFormatterBufferAppend(buffer, type)); \
+    }
 
-        return ZyanStringAppendFormat(string, "sub_%" PRIx64, address);
-    } else if (address >= func->executable().base_address() && address <= func->executable().end_address()) {
-        // Data if in another section?
-        ZYAN_CHECK(ZydisFormatterBufferAppend(buffer, ZYDIS_TOKEN_SYMBOL));
+    if (reg >= ZYDIS_REGISTER_ST0 && reg <= ZYDIS_REGISTER_ST7) {
+        ZYDIS_BUFFER_APPEND_TOKEN(buffer, ZYDIS_TOKEN_REGISTER);
         ZyanString *string;
         ZYAN_CHECK(ZydisFormatterBufferGetString(buffer, &string));
-        const unassemblize::Executable::Symbol &symbol = func->executable().get_symbol(address);
-
-        if (!symbol.name.empty()) {
-            func->add_dependency(symbol.name);
-            return ZyanStringAppendFormat(string, "%s", symbol.name.c_str());
-        }
+        return ZyanStringAppendFormat(string, "st(%d)", reg - 69);
+    }
 
-        snprintf(hex_buff, sizeof(hex_buff), "off_%" PRIx64, address);
-        func->add_dependency(hex_buff);
+    unassemblize::Function *func = static_cast<unassemblize::Function *>(context->user_data);
+    return func->setup().default_format_print_reg(formatter, buffer, context, reg);
+}
 
-        return ZyanStringAppendFormat(string, "off_%" PRIx64, address);
+ZydisStackWidth stack_width_for_mode(ZydisMachineMode machine_mode)
+{
+    // Derive the stack width from the address width.
+    switch (machine_mode) {
+        case ZYDIS_MACHINE_MODE_LONG_64:
+            return ZYDIS_STACK_WIDTH_64;
+        case ZYDIS_MACHINE_MODE_LONG_COMPAT_32:
+        case ZYDIS_MACHINE_MODE_LEGACY_32:
+            return ZYDIS_STACK_WIDTH_32;
+        case ZYDIS_MACHINE_MODE_LONG_COMPAT_16:
+        case ZYDIS_MACHINE_MODE_LEGACY_16:
+        case ZYDIS_MACHINE_MODE_REAL_16:
+        default:
+            return ZYDIS_STACK_WIDTH_16;
     }
-
-    return default_print_address_relative(formatter, buffer, context);
 }
 
-ZydisFormatterFunc default_print_immediate;
+ZydisFormatterStyle style_for_format(unassemblize::Function::AsmFormat fmt)
+{
+    switch (fmt) {
+        case unassemblize::Function::FORMAT_MASM:
+            return ZYDIS_FORMATTER_STYLE_INTEL_MASM;
+        case unassemblize::Function::FORMAT_AGAS:
+            return ZYDIS_FORMATTER_STYLE_ATT;
+        case unassemblize::Function::FORMAT_IGAS:
+        case unassemblize::Function::FORMAT_DEFAULT:
+        default:
+            return ZYDIS_FORMATTER_STYLE_INTEL;
+    }
+}
+} // namespace
 
-static ZyanStatus UnasmFormatterPrintIMM(
-    const ZydisFormatter *formatter, ZydisFormatterBuffer *buffer, ZydisFormatterContext *context)
+unassemblize::FunctionSetup::FunctionSetup(Function::AsmFormat format, ZydisMachineMode mode) :
+    m_format(format), m_machineMode(mode)
 {
-    unassemblize::Function *func = static_cast<unassemblize::Function *>(context->user_data);
-    uint64_t address = context->operand->imm.value.u;
-    char hex_buff[32];
-    const unassemblize::Executable::Symbol &symbol = func->executable().get_symbol(address);
+    m_status = ZydisDecoderInit(&m_decoder, m_machineMode, stack_width_for_mode(m_machineMode));
 
-    if (!symbol.name.empty()) {
-        ZYAN_CHECK(ZydisFormatterBufferAppend(buffer, ZYDIS_TOKEN_SYMBOL));
-        ZyanString *string;
-        ZYAN_CHECK(ZydisFormatterBufferGetString(buffer, &string));
-        auto it = func->labels().find(address);
-        return ZyanStringAppendFormat(string, "offset %s", symbol.name.c_str());
-    } else if (address >= func->section_address() && address <= func->section_end()) {
-        // Probably a function if the address is in the current section.
-        ZYAN_CHECK(ZydisFormatterBufferAppend(buffer, ZYDIS_TOKEN_SYMBOL));
-        ZyanString *string;
-        ZYAN_CHECK(ZydisFormatterBufferGetString(buffer, &string));
-        const unassemblize::Executable::Symbol &symbol = func->executable().get_symbol(address);
+    if (!ZYAN_SUCCESS(m_status)) {
+        return;
+    }
 
-        if (!symbol.name.empty()) {
-            func->add_dependency(symbol.name);
-            return ZyanStringAppendFormat(string, "offset %s", symbol.name.c_str());
-        }
+    m_status = ZydisFormatterInit(&m_formatter, style_for_format(m_format));
 
-        snprintf(hex_buff, sizeof(hex_buff), "offset sub_%" PRIx64, address);
-        func->add_dependency(hex_buff);
+    if (!ZYAN_SUCCESS(m_status)) {
+        return;
+    }
 
-        return ZyanStringAppendFormat(string, "offset sub_%" PRIx64, address);
-    } else if (address >= func->executable().base_address() && address <= (func->executable().end_address())) {
-        // Data if in another section?
-        ZYAN_CHECK(ZydisFormatterBufferAppend(buffer, ZYDIS_TOKEN_SYMBOL));
-        ZyanString *string;
-        ZYAN_CHECK(ZydisFormatterBufferGetString(buffer, &string));
-        const unassemblize::Executable::Symbol &symbol = func->executable().get_symbol(address);
+    ZydisFormatterSetProperty(&m_formatter, ZYDIS_FORMATTER_PROP_FORCE_SIZE, ZYAN_TRUE);
 
-        if (!symbol.name.empty()) {
-            func->add_dependency(symbol.name);
-            return ZyanStringAppendFormat(string, "offset %s", symbol.name.c_str());
-        }
+    default_print_address_absolute = (ZydisFormatterFunc)&UnasmFormatterPrintOperand<AbsoluteOperand>;
+    ZydisFormatterSetHook(
+        &m_formatter, ZYDIS_FORMATTER_FUNC_PRINT_ADDRESS_ABS, (const void **)&default_print_address_absolute);
 
-        snprintf(hex_buff, sizeof(hex_buff), "offset off_%" PRIx64, address);
-        func->add_dependency(hex_buff);
+    default_print_immediate = (ZydisFormatterFunc)&UnasmFormatterPrintOperand<ImmediateOperand>;
+    ZydisFormatterSetHook(&m_formatter, ZYDIS_FORMATTER_FUNC_PRINT_IMM, (const void **)&default_print_immediate);
 
-        return ZyanStringAppendFormat(string, "offset off_%" PRIx64, address);
-    }
+    default_print_address_relative = (ZydisFormatterFunc)&UnasmFormatterPrintOperand<RelativeOperand>;
+    ZydisFormatterSetHook(
+        &m_formatter, ZYDIS_FORMATTER_FUNC_PRINT_ADDRESS_REL, (const void **)&default_print_address_relative);
 
-    return default_print_immediate(formatter, buffer, context);
-}
+    default_print_displacement = (ZydisFormatterFunc)&UnasmFormatterPrintOperand<DisplacementOperand>;
+    ZydisFormatterSetHook(&m_formatter, ZYDIS_FORMATTER_FUNC_PRINT_DISP, (const void **)&default_print_displacement);
 
-ZydisFormatterFunc default_print_displacement;
+    default_format_operand_ptr = (ZydisFormatterFunc)&UnasmFormatterPrintOperand<PointerOperand>;
+    ZydisFormatterSetHook(
+        &m_formatter, ZYDIS_FORMATTER_FUNC_FORMAT_OPERAND_PTR, (const void **)&default_format_operand_ptr);
 
-static ZyanStatus UnasmFormatterPrintDISP(
-    const ZydisFormatter *formatter, ZydisFormatterBuffer *buffer, ZydisFormatterContext *context)
+    default_format_operand_mem = (ZydisFormatterFunc)&UnasmFormatterPrintOperand<MemoryOperand>;
+    ZydisFormatterSetHook(
+        &m_formatter, ZYDIS_FORMATTER_FUNC_FORMAT_OPERAND_MEM, (const void **)&default_format_operand_mem);
+
+    default_format_print_reg = (ZydisFormatterRegisterFunc)&UnasmFormatterFormatPrintRegister;
+    ZydisFormatterSetHook(&m_formatter, ZYDIS_FORMATTER_FUNC_PRINT_REGISTER, (const void **)&default_format_print_reg);
+}
+
+ZyanStatus unassemblize::FunctionSetup::decode(
+    const void *buffer, ZyanUSize length, ZydisDecodedInstruction *info, ZydisDecodedOperand *operands) const
 {
-    unassemblize::Function *func = static_cast<unassemblize::Function *>(context->user_data);
-    uint64_t address = context->operand->mem.disp.value;
-    char hex_buff[32];
-    const unassemblize::Executable::Symbol &symbol = func->executable().get_symbol(address);
+    if (!buffer || !info || !operands) {
+        return ZYAN_STATUS_INVALID_ARGUMENT;
+    }
 
-    if (!symbol.name.empty()) {
-        ZYAN_CHECK(ZydisFormatterBufferAppend(buffer, ZYDIS_TOKEN_SYMBOL));
-        ZyanString *string;
-        ZYAN_CHECK(ZydisFormatterBufferGetString(buffer, &string));
-        auto it = func->labels().find(address);
-        return ZyanStringAppendFormat(string, "+%s", symbol.name.c_str());
-    } else if (address >= func->section_address() && address <= func->section_end()) {
-        // Probably a function if the address is in the current section.
-        ZYAN_CHECK(ZydisFormatterBufferAppend(buffer, ZYDIS_TOKEN_SYMBOL));
-        ZyanString *string;
-        ZYAN_CHECK(ZydisFormatterBufferGetString(buffer, &string));
-        const unassemblize::Executable::Symbol &symbol = func->executable().get_nearest_symbol(address);
+    ZYAN_CHECK(m_status);
 
-        if (!symbol.name.empty()) {
-            func->add_dependency(symbol.name);
+    ZydisDecoderContext ctx;
+    ZYAN_CHECK(ZydisDecoderDecodeInstruction(&m_decoder, &ctx, buffer, length, info));
+    ZYAN_CHECK(ZydisDecoderDecodeOperands(&m_decoder, &ctx, info, operands, info->operand_count_visible));
 
-            if (symbol.value == address) {
-                return ZyanStringAppendFormat(string, "+%s", symbol.name.c_str());
-            } else {
-                uint64_t diff = address - symbol.value; // value should always be lower than requested address.
-                return ZyanStringAppendFormat(string, "+%s+0x%" PRIx64, symbol.name.c_str(), diff);
-            }
-        }
+    return ZYAN_STATUS_SUCCESS;
+}
+
+ZyanStatus unassemblize::FunctionSetup::format_instruction(const ZydisDecodedInstruction *info,
+    const ZydisDecodedOperand *operands, ZyanU64 runtime_address, char *buffer, ZyanUSize length, void *user_data) const
+{
+    ZYAN_CHECK(m_status);
 
-        snprintf(hex_buff, sizeof(hex_buff), "sub_%" PRIx64, address);
-        func->add_dependency(hex_buff);
+    return ZydisFormatterFormatInstruction(
+        &m_formatter, info, operands, info->operand_count_visible, buffer, length, runtime_address, user_data);
+}
 
-        return ZyanStringAppendFormat(string, "+sub_%" PRIx64, address);
-    } else if (address >= func->executable().base_address() && address <= (func->executable().end_address())) {
-        // Data if in another section?
-        ZYAN_CHECK(ZydisFormatterBufferAppend(buffer, ZYDIS_TOKEN_SYMBOL));
-        ZyanString *string;
-        ZYAN_CHECK(ZydisFormatterBufferGetString(buffer, &string));
-        const unassemblize::Executable::Symbol &symbol = func->executable().get_nearest_symbol(address);
+void unassemblize::Function::disassemble(AsmFormat fmt)
+{
+    FunctionSetup setup(fmt);
+    disassemble(setup);
+}
 
-        if (!symbol.name.empty()) {
-            func->add_dependency(symbol.name);
+void unassemblize::Function::disassemble(const FunctionSetup &setup)
+{
+    StringSink output(m_dissassembly);
+    disassemble(setup, output);
+}
 
-            if (symbol.value == address) {
-                return ZyanStringAppendFormat(string, "+%s", symbol.name.c_str());
-            } else {
-                uint64_t diff = address - symbol.value; // value should always be lower than requested address.
-                return ZyanStringAppendFormat(string, "+%s+0x%" PRIx64, symbol.name.c_str(), diff);
-            }
-        }
+void unassemblize::Function::disassemble(const FunctionSetup &setup, OutputSink &output)
+{
+    const uint8_t *section_data = m_executable.section_data(m_section.c_str());
+    uint64_t section_size = m_executable.section_size(m_section.c_str());
 
-        snprintf(hex_buff, sizeof(hex_buff), "off_%" PRIx64, address);
-        func->add_dependency(hex_buff);
+    // Sections without file content such as .bss have nothing to decode.
+    if (section_data == nullptr || section_size == 0) {
+        return;
+    }
 
-        return ZyanStringAppendFormat(string, "+off_%" PRIx64, address);
+    m_setup = &setup;
+    m_deps.clear();
+    m_references.clear();
+    m_lookups.clear();
+    if (setup.machine_mode() == ZYDIS_MACHINE_MODE_LONG_64) {
+        decode<ZYDIS_MACHINE_MODE_LONG_64>(section_data, section_size);
+    } else {
+        decode<ZYDIS_MACHINE_MODE_LEGACY_32>(section_data, section_size);
     }
 
-    return default_print_displacement(formatter, buffer, context);
+    if (setup.format() == FORMAT_MASM) {
+        format<true>(output);
+    } else {
+        format<false>(output);
+    }
+
+    resolve_dependencies();
 }
 
-ZydisFormatterFunc default_format_operand_ptr;
+const char *unassemblize::Function::symbol_name(uint64_t address)
+{
+    uint32_t name = find_symbol(address).name;
 
-static ZyanStatus UnasmFormatterFormatOperandPTR(
-    const ZydisFormatter *formatter, ZydisFormatterBuffer *buffer, ZydisFormatterContext *context)
+    return name != StringPool::empty ? m_executable.name(name) : label_name(address);
+}
+
+const char *unassemblize::Function::label_name(uint64_t address) const
 {
-    unassemblize::Function *func = static_cast<unassemblize::Function *>(context->user_data);
-    uint64_t address = context->operand->ptr.offset;
-    char hex_buff[32];
-    const unassemblize::Executable::Symbol &symbol = func->executable().get_symbol(address);
+    if (!m_labels.contains(address)) {
+        return "";
+    }
 
-    if (!symbol.name.empty()) {
-        ZYAN_CHECK(ZydisFormatterBufferAppend(buffer, ZYDIS_TOKEN_SYMBOL));
-        ZyanString *string;
-        ZYAN_CHECK(ZydisFormatterBufferGetString(buffer, &string));
-        auto it = func->labels().find(address);
-        return ZyanStringAppendFormat(string, "%s", symbol.name.c_str());
-    } else if (address >= func->section_address() && address <= func->section_end()) {
-        // Probably a function if the address is in the current section.
-        ZYAN_CHECK(ZydisFormatterBufferAppend(buffer, ZYDIS_TOKEN_SYMBOL));
-        ZyanString *string;
-        ZYAN_CHECK(ZydisFormatterBufferGetString(buffer, &string));
-        const unassemblize::Executable::Symbol &symbol = func->executable().get_symbol(address);
+    LabelTable::format_name(m_labelName, address);
 
-        if (!symbol.name.empty()) {
-            func->add_dependency(symbol.name);
-            return ZyanStringAppendFormat(string, "%s", symbol.name.c_str());
-        }
+    return m_labelName;
+}
 
-        snprintf(hex_buff, sizeof(hex_buff), "sub_%" PRIx64, address);
-        func->add_dependency(hex_buff);
+void unassemblize::Function::resolve_dependencies()
+{
+    static const char *const prefixes[] = {"sub_", "off_", "unk_"};
 
-        return ZyanStringAppendFormat(string, "sub_%" PRIx64, address);
-    } else if (address >= func->executable().base_address() && address <= func->executable().end_address()) {
-        // Data if in another section?
-        ZYAN_CHECK(ZydisFormatterBufferAppend(buffer, ZYDIS_TOKEN_SYMBOL));
-        ZyanString *string;
-        ZYAN_CHECK(ZydisFormatterBufferGetString(buffer, &string));
-        const unassemblize::Executable::Symbol &symbol = func->executable().get_symbol(address);
+    // Each distinct generated name is built and interned once however often the function used it.
+    std::sort(m_references.begin(), m_references.end(), [](const Reference &a, const Reference &b) {
+        return a.type != b.type ? a.type < b.type : a.address < b.address;
+    });
+
+    for (size_t i = 0; i < m_references.size(); ++i) {
+        const Reference &ref = m_references[i];
 
-        if (!symbol.name.empty()) {
-            func->add_dependency(symbol.name);
-            return ZyanStringAppendFormat(string, "%s", symbol.name.c_str());
+        if (i != 0 && ref.type == m_references[i - 1].type && ref.address == m_references[i - 1].address) {
+            continue;
         }
 
-        snprintf(hex_buff, sizeof(hex_buff), "unk_%" PRIx64, address);
-        func->add_dependency(hex_buff);
+        char name[32];
+        snprintf(name, sizeof(name), "%s%" PRIx64, prefixes[ref.type], ref.address);
+        add_dependency(m_executable.intern_name(name), ref.type == REFERENCE_SUB ? DEPENDENCY_CODE : DEPENDENCY_DATA);
+    }
+
+    m_references.clear();
 
-        return ZyanStringAppendFormat(string, "unk_%" PRIx64, address);
+    // Merge repeats of a name into one entry carrying every way it was referenced.
+    std::sort(m_deps.begin(), m_deps.end(), [](const Dependency &a, const Dependency &b) { return a.name < b.name; });
+    size_t count = 0;
+
+    for (size_t i = 0; i < m_deps.size(); ++i) {
+        if (count != 0 && m_deps[count - 1].name == m_deps[i].name) {
+            m_deps[count - 1].flags |= m_deps[i].flags;
+        } else {
+            m_deps[count++] = m_deps[i];
+        }
     }
 
-    return default_format_operand_ptr(formatter, buffer, context);
+    m_deps.resize(count);
 }
 
-ZydisFormatterFunc default_format_operand_mem;
-
-static ZyanStatus UnasmFormatterFormatOperandMEM(
-    const ZydisFormatter *formatter, ZydisFormatterBuffer *buffer, ZydisFormatterContext *context)
+template<ZydisMachineMode Mode> void unassemblize::Function::decode(const uint8_t *section_data, uint64_t section_size)
 {
-    unassemblize::Function *func = static_cast<unassemblize::Function *>(context->user_data);
-    uint64_t address = context->operand->mem.disp.value;
-    char hex_buff[32];
-    const unassemblize::Executable::Symbol &symbol = func->executable().get_symbol(address);
+    uint64_t offset = m_startAddress - m_executable.section_address(m_section.c_str());
+    uint64_t end_offset = m_endAddress - m_executable.section_address(m_section.c_str());
+    uint64_t runtime_address = m_startAddress;
+    uint64_t next_table = UINT64_MAX;
+    DecodedInstruction decoded;
+
+    m_instructions.clear();
+    m_decoded.clear();
+    m_jumpTables.clear();
+    m_labels.reset(m_startAddress, m_endAddress);
+    m_readEnd = m_startAddress;
+
+    // Decode the function once, identifying all jumps to local labels and creating them as we go.
+    while (offset <= end_offset && offset < section_size) {
+        // Tables found by earlier jumps are added as data rather than decoded as instructions.
+        if (runtime_address == next_table) {
+            uint64_t size = add_table_entries(runtime_address);
+            offset += size;
+            runtime_address += size;
+            next_table = next_table_start(runtime_address);
+            continue;
+        }
 
-    if ((context->operand->mem.type == ZYDIS_MEMOP_TYPE_MEM) || (context->operand->mem.type == ZYDIS_MEMOP_TYPE_VSIB)) {
-        ZYAN_CHECK(formatter->func_print_typecast(formatter, buffer, context));
-    }
-    ZYAN_CHECK(formatter->func_print_segment(formatter, buffer, context));
+        ZyanUSize length = std::min<uint64_t>(
+            {section_size - offset, ZYDIS_MAX_INSTRUCTION_LENGTH, next_table - runtime_address});
+        m_readEnd = std::max(m_readEnd, runtime_address + length);
+
+        if (!ZYAN_SUCCESS(m_setup->decode(section_data + offset, length, &decoded.info, decoded.operands))) {
+            // Only stopping short of a table made this fail, most likely a bad table guess. Rather than dropping the
+            // rest of the function, keep the bytes up to the table as data so the output still has the same bytes.
+            // Each byte starts a run of data so a label pointing at any of them is still written.
+            if (length == next_table - runtime_address
+                && length < std::min<uint64_t>(section_size - offset, ZYDIS_MAX_INSTRUCTION_LENGTH)) {
+                for (ZyanUSize i = 0; i < length; ++i) {
+                    Instruction instruction = {};
+                    instruction.target = section_data[offset + i];
+                    instruction.offset = static_cast<uint32_t>(runtime_address + i - m_startAddress);
+                    instruction.length = 1;
+                    instruction.flags = INSTRUCTION_TABLE_ENTRY | INSTRUCTION_TABLE_BYTE | INSTRUCTION_TABLE_START;
+                    m_instructions.push_back(instruction);
+                }
 
-    if (!symbol.name.empty()) {
-        ZYAN_CHECK(ZydisFormatterBufferAppend(buffer, ZYDIS_TOKEN_SYMBOL));
-        ZyanString *string;
-        ZYAN_CHECK(ZydisFormatterBufferGetString(buffer, &string));
-        auto it = func->labels().find(address);
-        return ZyanStringAppendFormat(string, "[%s]", symbol.name.c_str());
-    } else if (address >= func->section_address() && address <= func->section_end()) {
-        // Probably a function if the address is in the current section.
-        ZYAN_CHECK(ZydisFormatterBufferAppend(buffer, ZYDIS_TOKEN_SYMBOL));
-        ZyanString *string;
-        ZYAN_CHECK(ZydisFormatterBufferGetString(buffer, &string));
-        const unassemblize::Executable::Symbol &symbol = func->executable().get_symbol(address);
+                offset += length;
+                runtime_address += length;
+                continue;
+            }
 
-        if (!symbol.name.empty()) {
-            func->add_dependency(symbol.name);
-            return ZyanStringAppendFormat(string, "[%s]", symbol.name.c_str());
+            break;
         }
 
-        snprintf(hex_buff, sizeof(hex_buff), "sub_%" PRIx64, address);
-        func->add_dependency(hex_buff);
+        Instruction instruction = {};
+        instruction.offset = static_cast<uint32_t>(runtime_address - m_startAddress);
+        instruction.decoded = static_cast<uint32_t>(m_decoded.size());
+        instruction.mnemonic = decoded.info.mnemonic;
+        instruction.length = decoded.info.length;
 
-        return ZyanStringAppendFormat(string, "[sub_%" PRIx64 "]", address);
-    } else if (address >= func->executable().base_address() && address <= func->executable().end_address()) {
-        // Data if in another section?
-        ZYAN_CHECK(ZydisFormatterBufferAppend(buffer, ZYDIS_TOKEN_SYMBOL));
-        ZyanString *string;
-        ZYAN_CHECK(ZydisFormatterBufferGetString(buffer, &string));
-        const unassemblize::Executable::Symbol &symbol = func->executable().get_symbol(address);
+        for (ZyanU8 i = 0; i < decoded.info.operand_count_visible; ++i) {
+            instruction.operand_types |= 1 << decoded.operands[i].type;
+        }
 
-        if (!symbol.name.empty()) {
-            func->add_dependency(symbol.name);
-            return ZyanStringAppendFormat(string, "[%s]", symbol.name.c_str());
+        if (decoded.info.raw.imm->is_relative) {
+            ZydisCalcAbsoluteAddress(&decoded.info, decoded.operands, runtime_address, &instruction.target);
+            instruction.flags |= INSTRUCTION_RELATIVE;
+            m_labels.add(instruction.target);
         }
 
-        snprintf(hex_buff, sizeof(hex_buff), "unk_%" PRIx64, address);
-        func->add_dependency(hex_buff);
+        if constexpr (Mode == ZYDIS_MACHINE_MODE_LONG_64) {
+            // Data and code inside the function reached through rip relative operands get labels like branches do.
+            for (ZyanU8 i = 0; i < decoded.info.operand_count_visible; ++i) {
+                const ZydisDecodedOperand &operand = decoded.operands[i];
+                uint64_t target;
 
-        return ZyanStringAppendFormat(string, "[unk_%" PRIx64 "]", address);
-    }
+                if (operand.type == ZYDIS_OPERAND_TYPE_MEMORY && operand.mem.base == ZYDIS_REGISTER_RIP
+                    && ZYAN_SUCCESS(ZydisCalcAbsoluteAddress(&decoded.info, &operand, runtime_address, &target))) {
+                    m_labels.add(target);
+                }
+            }
+        }
 
-    return default_format_operand_mem(formatter, buffer, context);
-}
+        m_instructions.push_back(instruction);
+        m_decoded.push_back(decoded);
+        offset += instruction.length;
+        runtime_address += instruction.length;
 
-ZydisFormatterRegisterFunc default_format_print_reg;
+        JumpTable table;
 
-static ZyanStatus UnasmFormatterFormatPrintRegister(
-    const ZydisFormatter *formatter, ZydisFormatterBuffer *buffer, ZydisFormatterContext *context, ZydisRegister reg)
-{
-    // Copied from internal FormatterBase.h
-#define ZYDIS_BUFFER_APPEND_TOKEN(buffer, type) \
-    if ((buffer)->is_token_list) { \
-        ZYAN_CHECK(ZydisFormatterBufferAppend(buffer, type)); \
+        if (instruction.mnemonic == ZYDIS_MNEMONIC_JMP
+            && find_jump_table<Mode>(
+                m_executable, m_decoded.data(), m_decoded.size(), m_startAddress, m_endAddress, table)) {
+            add_jump_table(table);
+            next_table = next_table_start(runtime_address);
+        }
     }
+}
 
-    if (reg >= ZYDIS_REGISTER_ST0 && reg <= ZYDIS_REGISTER_ST7) {
-        ZYDIS_BUFFER_APPEND_TOKEN(buffer, ZYDIS_TOKEN_REGISTER);
-        ZyanString *string;
-        ZYAN_CHECK(ZydisFormatterBufferGetString(buffer, &string));
-        return ZyanStringAppendFormat(string, "st(%d)", reg - 69);
+bool unassemblize::Function::find_jump_table(const Executable &exe, ZydisMachineMode mode,
+    const DecodedInstruction *decoded, size_t count, uint64_t start, uint64_t end, JumpTable &table)
+{
+    if (mode == ZYDIS_MACHINE_MODE_LONG_64) {
+        return find_jump_table<ZYDIS_MACHINE_MODE_LONG_64>(exe, decoded, count, start, end, table);
     }
 
-    return default_format_print_reg(formatter, buffer, context, reg);
+    return find_jump_table<ZYDIS_MACHINE_MODE_LEGACY_32>(exe, decoded, count, start, end, table);
 }
 
-static ZyanStatus UnasmDisassembleCustom(ZydisMachineMode machine_mode, ZyanU64 runtime_address, const void *buffer,
-    ZyanUSize length, ZydisDisassembledInstruction *instruction, void *user_data, ZydisFormatterStyle style)
+template<ZydisMachineMode Mode>
+bool unassemblize::Function::find_jump_table(const Executable &exe, const DecodedInstruction *decoded, size_t count,
+    uint64_t start, uint64_t end, JumpTable &table)
 {
-    if (!buffer || !instruction) {
-        return ZYAN_STATUS_INVALID_ARGUMENT;
+    if (count == 0) {
+        return false;
     }
 
-    memset(instruction, 0, sizeof(*instruction));
-    instruction->runtime_address = runtime_address;
+    const DecodedInstruction &jump = decoded[count - 1];
+    const ZydisDecodedOperand &target = jump.operands[0];
 
-    // Derive the stack width from the address width.
-    ZydisStackWidth stack_width;
-    switch (machine_mode) {
-        case ZYDIS_MACHINE_MODE_LONG_64:
-            stack_width = ZYDIS_STACK_WIDTH_64;
-            break;
-        case ZYDIS_MACHINE_MODE_LONG_COMPAT_32:
-        case ZYDIS_MACHINE_MODE_LEGACY_32:
-            stack_width = ZYDIS_STACK_WIDTH_32;
-            break;
-        case ZYDIS_MACHINE_MODE_LONG_COMPAT_16:
-        case ZYDIS_MACHINE_MODE_LEGACY_16:
-        case ZYDIS_MACHINE_MODE_REAL_16:
-            stack_width = ZYDIS_STACK_WIDTH_16;
-            break;
-        default:
-            return ZYAN_STATUS_INVALID_ARGUMENT;
+    // Only jmp [index*size+table], a base register means the table address isn't known until run time.
+    if (jump.info.operand_count_visible == 0 || target.type != ZYDIS_OPERAND_TYPE_MEMORY
+        || target.mem.base != ZYDIS_REGISTER_NONE || target.mem.index == ZYDIS_REGISTER_NONE
+        || (target.mem.scale != 4 && target.mem.scale != 8) || target.mem.disp.value == 0) {
+        return false;
     }
 
-    ZydisDecoder decoder;
-    ZYAN_CHECK(ZydisDecoderInit(&decoder, machine_mode, stack_width));
+    const uint64_t address_mask = Mode == ZYDIS_MACHINE_MODE_LONG_64 ? UINT64_MAX : UINT32_MAX;
+    auto enclosing = [](ZydisRegister reg) { return ZydisRegisterGetLargestEnclosing(Mode, reg); };
+    ZydisRegister index = enclosing(target.mem.index);
+    ZydisMnemonic bound_jump = ZYDIS_MNEMONIC_INVALID;
+    table = {};
+    table.address = uint64_t(target.mem.disp.value) & address_mask;
+    table.entry_size = target.mem.scale;
+
+    // Walk back from the jump looking for "cmp index, max; ja default", picking up a movzx from a byte table on the way.
+    size_t first = count > MAX_SWITCH_SCAN ? count - MAX_SWITCH_SCAN : 0;
+
+    for (size_t i = count - 1; i-- > first;) {
+        const DecodedInstruction &prev = decoded[i];
+        const ZydisDecodedOperand *ops = prev.operands;
+        ZydisMnemonic mnemonic = prev.info.mnemonic;
+
+        if (bound_jump == ZYDIS_MNEMONIC_INVALID && (mnemonic == ZYDIS_MNEMONIC_JNBE || mnemonic == ZYDIS_MNEMONIC_JNB)) {
+            bound_jump = mnemonic;
+            continue;
+        }
 
-    ZydisDecoderContext ctx;
-    ZYAN_CHECK(ZydisDecoderDecodeInstruction(&decoder, &ctx, buffer, length, &instruction->info));
-    ZYAN_CHECK(ZydisDecoderDecodeOperands(
-        &decoder, &ctx, &instruction->info, instruction->operands, instruction->info.operand_count));
+        if (bound_jump != ZYDIS_MNEMONIC_INVALID && mnemonic == ZYDIS_MNEMONIC_CMP && prev.info.operand_count_visible == 2
+            && ops[0].type == ZYDIS_OPERAND_TYPE_REGISTER && ops[1].type == ZYDIS_OPERAND_TYPE_IMMEDIATE
+            && enclosing(ops[0].reg.value) == index) {
+            uint64_t count = ops[1].imm.value.u + (bound_jump == ZYDIS_MNEMONIC_JNBE ? 1 : 0);
+            (table.index_address != 0 ? table.index_count : table.count) =
+                static_cast<uint32_t>(std::min<uint64_t>(count, MAX_TABLE_ENTRIES));
+            break;
+        }
 
-    ZydisFormatter formatter;
-    ZYAN_CHECK(ZydisFormatterInit(&formatter, style));
+        if (bound_jump == ZYDIS_MNEMONIC_INVALID && table.index_address == 0 && mnemonic == ZYDIS_MNEMONIC_MOVZX
+            && ops[0].type == ZYDIS_OPERAND_TYPE_REGISTER && enclosing(ops[0].reg.value) == index
+            && ops[1].type == ZYDIS_OPERAND_TYPE_MEMORY && ops[1].size == 8 && ops[1].mem.disp.value != 0
+            && (ops[1].mem.base == ZYDIS_REGISTER_NONE) != (ops[1].mem.index == ZYDIS_REGISTER_NONE)
+            && ops[1].mem.scale <= 1) {
+            ZydisRegister byte_index = ops[1].mem.index != ZYDIS_REGISTER_NONE ? ops[1].mem.index : ops[1].mem.base;
+            table.index_address = uint64_t(ops[1].mem.disp.value) & address_mask;
+            index = enclosing(byte_index);
+            continue;
+        }
 
-    ZydisFormatterSetProperty(&formatter, ZYDIS_FORMATTER_PROP_FORCE_SIZE, ZYAN_TRUE);
+        // Anything else changing the index or leaving the straight line code means the bound can't be trusted.
+        ZydisInstructionCategory category = prev.info.meta.category;
+        bool writes_index = category == ZYDIS_CATEGORY_UNCOND_BR || category == ZYDIS_CATEGORY_RET
+            || category == ZYDIS_CATEGORY_CALL;
 
-    default_print_address_absolute = (ZydisFormatterFunc)&UnasmFormatterPrintAddressAbsolute;
-    ZydisFormatterSetHook(
-        &formatter, ZYDIS_FORMATTER_FUNC_PRINT_ADDRESS_ABS, (const void **)&default_print_address_absolute);
+        for (ZyanU8 j = 0; j < prev.info.operand_count_visible; ++j) {
+            writes_index = writes_index
+                || (ops[j].type == ZYDIS_OPERAND_TYPE_REGISTER && (ops[j].actions & ZYDIS_OPERAND_ACTION_MASK_WRITE)
+                    && enclosing(ops[j].reg.value) == index);
+        }
 
-    default_print_immediate = (ZydisFormatterFunc)&UnasmFormatterPrintIMM;
-    ZydisFormatterSetHook(&formatter, ZYDIS_FORMATTER_FUNC_PRINT_IMM, (const void **)&default_print_immediate);
+        if (writes_index) {
+            break;
+        }
+    }
 
-    default_print_address_relative = (ZydisFormatterFunc)&UnasmFormatterPrintAddressRelative;
-    ZydisFormatterSetHook(
-        &formatter, ZYDIS_FORMATTER_FUNC_PRINT_ADDRESS_REL, (const void **)&default_print_address_relative);
+    // The jump table has as many entries as the largest value in the byte table selects.
+    if (table.index_address != 0) {
+        const uint8_t *bytes =
+            table.index_count != 0 ? table_data(exe, table.index_address, table.index_count) : nullptr;
+
+        if (bytes != nullptr) {
+            table.count = *std::max_element(bytes, bytes + table.index_count) + 1;
+        } else {
+            table.index_address = 0;
+            table.index_count = 0;
+            table.count = 0;
+        }
+    }
+
+    // Without a bound take entries for as long as they point into the function.
+    if (table.count == 0) {
+        while (table.count < MAX_TABLE_ENTRIES) {
+            const uint8_t *entry =
+                table_data(exe, table.address + uint64_t(table.count) * table.entry_size, table.entry_size);
+            uint64_t value = entry == nullptr ? 0 : table_entry(entry, table.entry_size);
 
-    default_print_displacement = (ZydisFormatterFunc)&UnasmFormatterPrintDISP;
-    ZydisFormatterSetHook(&formatter, ZYDIS_FORMATTER_FUNC_PRINT_DISP, (const void **)&default_print_displacement);
+            if (value < start || value > end) {
+                break;
+            }
 
-    default_format_operand_ptr = (ZydisFormatterFunc)&UnasmFormatterFormatOperandPTR;
-    ZydisFormatterSetHook(&formatter, ZYDIS_FORMATTER_FUNC_FORMAT_OPERAND_PTR, (const void **)&default_format_operand_ptr);
+            ++table.count;
+        }
+    }
 
-    default_format_operand_mem = (ZydisFormatterFunc)&UnasmFormatterFormatOperandMEM;
-    ZydisFormatterSetHook(&formatter, ZYDIS_FORMATTER_FUNC_FORMAT_OPERAND_MEM, (const void **)&default_format_operand_mem);
+    return table.count != 0 && table_data(exe, table.address, uint64_t(table.count) * table.entry_size) != nullptr;
+}
 
-    default_format_print_reg = (ZydisFormatterRegisterFunc)&UnasmFormatterFormatPrintRegister;
-    ZydisFormatterSetHook(&formatter, ZYDIS_FORMATTER_FUNC_PRINT_REGISTER, (const void **)&default_format_print_reg);
+void unassemblize::Function::add_jump_table(const JumpTable &table)
+{
+    const uint8_t *entries = table_data(table.address, uint64_t(table.count) * table.entry_size);
+    m_jumpTables.push_back(table);
+    m_labels.add(table.address);
 
-    ZYAN_CHECK(ZydisFormatterFormatInstruction(&formatter,
-        &instruction->info,
-        instruction->operands,
-        instruction->info.operand_count_visible,
-        instruction->text,
-        sizeof(instruction->text),
-        runtime_address,
-        user_data));
+    if (table.index_address != 0) {
+        m_labels.add(table.index_address);
+    }
 
-    return ZYAN_STATUS_SUCCESS;
+    for (uint32_t i = 0; i < table.count; ++i) {
+        const uint8_t *entry = entries + uint64_t(i) * table.entry_size;
+        m_labels.add(table_entry(entry, table.entry_size));
+    }
 }
-} // namespace
 
-void unassemblize::Function::disassemble(AsmFormat fmt)
+uint64_t unassemblize::Function::next_table_start(uint64_t address) const
 {
-    if (m_executable.section_size(m_section.c_str()) == 0) {
-        return;
-    }
+    uint64_t next = UINT64_MAX;
 
-    static bool in_jump_table;
+    // Tables elsewhere, or before code already decoded, are only used for their labels.
+    for (auto it = m_jumpTables.begin(); it != m_jumpTables.end(); ++it) {
+        if (it->address >= address && it->address <= m_endAddress) {
+            next = std::min(next, it->address);
+        }
 
-    ZyanUSize offset = m_startAddress - m_executable.section_address(m_section.c_str());
-    uint64_t runtime_address = m_startAddress;
-    ZyanUSize end_offset = m_endAddress - m_executable.section_address(m_section.c_str());
-    ZydisDisassembledInstruction instruction;
-
-    in_jump_table = false;
-
-    // Loop through function once to identify all jumps to local labels and create them.
-    while (ZYAN_SUCCESS(UnasmDisassembleNoFormat(ZYDIS_MACHINE_MODE_LEGACY_32,
-               runtime_address,
-               m_executable.section_data(m_section.c_str()) + offset,
-               96,
-               &instruction))
-        && offset <= end_offset) {
-        uint64_t address;
-
-        if (instruction.info.raw.imm->is_relative) {
-            ZydisCalcAbsoluteAddress(&instruction.info, instruction.operands, runtime_address, &address);
-
-            if (address >= m_startAddress && address <= m_endAddress && m_labels.find(address) == m_labels.end()) {
-                std::stringstream stream;
-                stream << std::hex << address;
-                m_labels[address] = std::string("loc_") + stream.str();
-                m_executable.add_symbol(m_labels[address].c_str(), address);
-            }
+        if (it->index_address >= address && it->index_address <= m_endAddress) {
+            next = std::min(next, it->index_address);
         }
+    }
 
-        offset += instruction.info.length;
-        runtime_address += instruction.info.length;
-
-        // If instruction is a nop or jmp, could be at an inline jump table.
-        if (instruction.info.mnemonic == ZYDIS_MNEMONIC_NOP || instruction.info.mnemonic == ZYDIS_MNEMONIC_JMP) {
-            uint64_t next_int = get_le32(m_executable.section_data(m_section.c_str()) + offset);
-            bool in_jump_table = false;
-
-            // Naive jump table detection attempt uint32_t representation happens to be in function address space.
-            while (next_int >= m_startAddress && next_int <= m_endAddress) {
-                // If this is first entry of jump table, create label to jump to.
-                if (!in_jump_table) {
-                    if (runtime_address >= m_startAddress && runtime_address <= m_endAddress
-                        && m_labels.find(runtime_address) == m_labels.end()) {
-                        std::stringstream stream;
-                        stream << std::hex << runtime_address;
-                        m_labels[runtime_address] = std::string("loc_") + stream.str();
-                        m_executable.add_symbol(m_labels[runtime_address].c_str(), runtime_address);
-                    }
-
-                    in_jump_table = true;
-                }
+    return next;
+}
 
-                if (m_labels.find(next_int) == m_labels.end()) {
-                    std::stringstream stream;
-                    stream << std::hex << next_int;
-                    m_labels[next_int] = std::string("loc_") + stream.str();
-                    m_executable.add_symbol(m_labels[next_int].c_str(), next_int);
-                }
+uint64_t unassemblize::Function::add_table_entries(uint64_t address)
+{
+    const JumpTable *table = nullptr;
+    bool is_index = false;
 
-                offset += sizeof(uint32_t);
-                runtime_address += sizeof(uint32_t);
-                next_int = get_le32(m_executable.section_data(m_section.c_str()) + offset);
-            }
+    for (auto it = m_jumpTables.begin(); it != m_jumpTables.end() && table == nullptr; ++it) {
+        if (it->address == address || it->index_address == address) {
+            table = &*it;
+            is_index = it->address != address;
         }
     }
 
-    offset = m_startAddress - m_executable.section_address(m_section.c_str());
-    runtime_address = m_startAddress;
-    in_jump_table = false;
-    ZydisFormatterStyle style;
-
-    switch (fmt) {
-        case FORMAT_MASM:
-            style = ZYDIS_FORMATTER_STYLE_INTEL_MASM;
-            break;
-        case FORMAT_AGAS:
-            style = ZYDIS_FORMATTER_STYLE_ATT;
-            break;
-        case FORMAT_IGAS:
-        case FORMAT_DEFAULT:
-            style = ZYDIS_FORMATTER_STYLE_INTEL;
-            break;
+    uint32_t entry_size = is_index ? 1 : table->entry_size;
+    uint32_t count = is_index ? table->index_count : table->count;
+    const uint8_t *data = table_data(address, uint64_t(count) * entry_size);
+
+    for (uint32_t i = 0; i < count; ++i) {
+        const uint8_t *entry = data + uint64_t(i) * entry_size;
+        Instruction instruction = {};
+        instruction.target = table_entry(entry, entry_size);
+        instruction.offset = static_cast<uint32_t>(address + uint64_t(i) * entry_size - m_startAddress);
+        instruction.length = entry_size;
+        instruction.flags = INSTRUCTION_TABLE_ENTRY | (i == 0 ? INSTRUCTION_TABLE_START : 0)
+            | (is_index ? INSTRUCTION_TABLE_BYTE : 0);
+        m_instructions.push_back(instruction);
     }
 
-    while (ZYAN_SUCCESS(UnasmDisassembleCustom(ZYDIS_MACHINE_MODE_LEGACY_32,
-               runtime_address,
-               m_executable.section_data(m_section.c_str()) + offset,
-               96,
-               &instruction,
-               this,
-               style))
-        && offset <= end_offset) {
-
-        if (m_labels.find(runtime_address) != m_labels.end()) {
-            m_dissassembly += m_labels[runtime_address];
-            m_dissassembly += ":\n";
-        }
+    m_readEnd = std::max(m_readEnd, address + uint64_t(count) * entry_size);
 
-        m_dissassembly += "    ";
-        m_dissassembly += instruction.text;
-        m_dissassembly += '\n';
-        offset += instruction.info.length;
-        runtime_address += instruction.info.length;
+    return uint64_t(count) * entry_size;
+}
 
-        // If instruction is a nop or jmp, could be at an inline jump table.
-        if (instruction.info.mnemonic == ZYDIS_MNEMONIC_NOP || instruction.info.mnemonic == ZYDIS_MNEMONIC_JMP) {
-            uint64_t next_int = get_le32(m_executable.section_data(m_section.c_str()) + offset);
-            bool in_jump_table = false;
+const uint8_t *unassemblize::Function::table_data(const Executable &exe, uint64_t address, uint64_t size)
+{
+    const Executable::Region *region = exe.classify(address);
+    const Executable::SectionInfo *section = region != nullptr ? region->section : nullptr;
 
-            // Naive jump table detection attempt uint32_t representation happens to be in function address space.
-            while (next_int >= m_startAddress && next_int <= m_endAddress) {
-                // If this is first entry of jump table, create label to jump to.
+    if (section == nullptr || section->data == nullptr || size > section->address + section->size - address) {
+        return nullptr;
+    }
 
-                if (!in_jump_table) {
-                    const unassemblize::Executable::Symbol &symbol = m_executable.get_symbol(runtime_address);
+    return section->data + (address - section->address);
+}
 
-                    if (!symbol.name.empty()) {
-                        m_dissassembly += symbol.name;
-                        m_dissassembly += ":\n";
-                    }
+uint64_t unassemblize::Function::table_entry(const uint8_t *entry, uint32_t entry_size)
+{
+    return entry_size == 1 ? *entry : entry_size == 8 ? get_le64(entry) : get_le32(entry);
+}
 
-                    in_jump_table = true;
-                }
+template<bool Masm> void unassemblize::Function::format(OutputSink &output)
+{
+    // Format from the instructions decoded earlier, the decoder is not needed again.
+    for (auto it = m_instructions.begin(); it != m_instructions.end(); ++it) {
+        uint64_t runtime_address = m_startAddress + it->offset;
 
-                const unassemblize::Executable::Symbol &symbol = m_executable.get_symbol(next_int);
+        if (it->flags & INSTRUCTION_TABLE_ENTRY) {
+            if (it->flags & INSTRUCTION_TABLE_START) {
+                const char *label = symbol_name(runtime_address);
 
-                if (!symbol.name.empty()) {
-                    if (fmt == FORMAT_MASM) {
-                        m_dissassembly += "    DWORD ";
-                    } else {
-                        m_dissassembly += "    .int ";
-                    }
-                    m_dissassembly += symbol.name;
-                    m_dissassembly += "\n";
+                if (*label != '\0') {
+                    output.write(label);
+                    output.write(":\n", 2);
                 }
+            }
+
+            // Byte table entries are plain values, jump table entries name their target or give it as a number.
+            static const char *const directives[2][3] = {{"    .byte ", "    .int ", "    .quad "},
+                {"    BYTE ", "    DWORD ", "    QWORD "}};
+            int width = it->flags & INSTRUCTION_TABLE_BYTE ? 0 : it->length == 8 ? 2 : 1;
+            const char *name = width != 0 ? symbol_name(it->target) : "";
+            output.write(directives[Masm][width]);
 
-                offset += sizeof(uint32_t);
-                runtime_address += sizeof(uint32_t);
-                next_int = get_le32(m_executable.section_data(m_section.c_str()) + offset);
+            if (*name != '\0') {
+                output.write(name);
+            } else {
+                char *value = output.reserve(32);
+                output.commit(snprintf(value, 32, width == 0 ? "%" PRIu64 : "0x%" PRIx64, it->target));
             }
+
+            output.put('\n');
+            continue;
         }
+
+        if (m_labels.contains(runtime_address)) {
+            char *label = output.reserve(LabelTable::MAX_NAME_LENGTH + 1);
+            size_t length = LabelTable::format_name(label, runtime_address);
+            label[length] = ':';
+            label[length + 1] = '\n';
+            output.commit(length + 2);
+        }
+
+        // Formatted in place after the indent, nothing is kept unless the formatter succeeds.
+        const DecodedInstruction &decoded = m_decoded[it->decoded];
+        char *line = output.reserve(INSTRUCTION_TEXT_LENGTH + 5);
+        memcpy(line, "    ", 4);
+
+        if (!ZYAN_SUCCESS(m_setup->format_instruction(
+                &decoded.info, decoded.operands, runtime_address, line + 4, INSTRUCTION_TEXT_LENGTH, this))) {
+            break;
+        }
+
+        size_t length = 4 + strlen(line + 4);
+        line[length] = '\n';
+        output.commit(length + 1);
     }
 }
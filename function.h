@@ -13,13 +13,17 @@
 #pragma once
 
 #include "executable.h"
-#include <map>
+#include "labeltable.h"
+#include "outputsink.h"
+#include <Zydis/Zydis.h>
 #include <stdint.h>
 #include <string>
 #include <vector>
 
 namespace unassemblize
 {
+class FunctionSetup;
+
 class Function
 {
 public:
@@ -31,32 +35,238 @@ public:
         FORMAT_MASM,
     };
 
+    enum InstructionFlags
+    {
+        INSTRUCTION_RELATIVE = 1 << 0, // Has a relative branch target.
+        INSTRUCTION_TABLE_ENTRY = 1 << 1, // Inline jump table entry or undecodable byte rather than an instruction.
+        INSTRUCTION_TABLE_START = 1 << 2, // First entry of an inline jump table or run of bytes, may have a label.
+        INSTRUCTION_TABLE_BYTE = 1 << 3, // Entry of a byte table selecting the jump table entry, target is its value.
+    };
+
+    enum DependencyFlags
+    {
+        DEPENDENCY_CODE = 1 << 0, // Referenced as code, a call, jump or function pointer.
+        DEPENDENCY_DATA = 1 << 1, // Referenced as data.
+    };
+
+    // Prefix of the name generated for a referenced address without a symbol.
+    enum ReferenceTypes
+    {
+        REFERENCE_SUB,
+        REFERENCE_OFF,
+        REFERENCE_UNK,
+    };
+
+    struct Dependency
+    {
+        uint32_t name; // Name id in the executable's pool.
+        uint32_t flags;
+    };
+
+    struct SymbolLookup
+    {
+        uint64_t address;
+        bool nearest;
+    };
+
+    /**
+     * Table an indirect jump picks its target from, found from the instructions leading up to the jump.
+     * Compilers often put a byte table in front of the jump table so many cases can share an entry.
+     */
+    struct JumpTable
+    {
+        uint64_t address;
+        uint64_t index_address; // Byte table indexing the jump table, 0 if the jump indexes it directly.
+        uint32_t count;
+        uint32_t index_count;
+        uint8_t entry_size;
+    };
+
+    /**
+     * Compact record of a single item of the function, either a decoded instruction or an inline jump table entry.
+     */
+    struct Instruction
+    {
+        uint64_t target; // Branch target for relative instructions, entry value for jump table entries.
+        uint32_t offset; // Offset from the start address of the function.
+        uint32_t decoded; // Index of the full decode used for formatting, unused for jump table entries.
+        ZydisMnemonic mnemonic;
+        uint8_t length;
+        uint8_t operand_types; // Bit set of the ZydisOperandType of each visible operand.
+        uint8_t flags;
+    };
+
+    struct DecodedInstruction
+    {
+        ZydisDecodedInstruction info;
+        ZydisDecodedOperand operands[ZYDIS_MAX_OPERAND_COUNT_VISIBLE];
+    };
+
 public:
     Function(Executable &exe, const char *section_name, uint64_t start, uint64_t end) :
-        m_section(section_name), m_startAddress(start), m_endAddress(end), m_executable(exe)
+        m_section(section_name),
+        m_sectionInfo(exe.section_info(section_name)),
+        m_startAddress(start),
+        m_endAddress(end),
+        m_readEnd(start),
+        m_executable(exe),
+        m_setup(nullptr),
+        m_recordLookups(false)
     {
     }
-    void disassemble(AsmFormat fmt = FORMAT_DEFAULT); // Run the dissassmbly of the function.
+    void disassemble(const FunctionSetup &setup, OutputSink &output); // Run the dissassmbly, streaming it to output.
+    void disassemble(const FunctionSetup &setup); // As above into the buffer returned by dissassembly().
+    void disassemble(AsmFormat fmt = FORMAT_DEFAULT); // As above with a one off setup for the given format.
     const std::string &dissassembly() const { return m_dissassembly; }
-    const std::vector<std::string> &dependencies() const { return m_deps; }
-    void add_dependency(const std::string &dep) { return m_deps.push_back(dep); }
+    /**
+     * Symbols the function references, each listed once in name id order.
+     */
+    const std::vector<Dependency> &dependencies() const { return m_deps; }
+    void add_dependency(uint32_t name, uint32_t flags) { m_deps.push_back({name, flags}); }
+    /**
+     * Records a reference to an address printed with a generated name, the name is only created once per function.
+     */
+    void add_reference(uint64_t address, ReferenceTypes type) { m_references.push_back({address, type}); }
     uint64_t start_address() const { return m_startAddress; }
+    uint64_t read_end() const { return m_readEnd; } // One past the last byte decoding looked at, can be past the end.
     uint64_t end_address() const { return m_endAddress; }
+    const Executable::SectionInfo *section_info() const { return m_sectionInfo; }
     uint64_t section_address() const { return m_executable.section_address(m_section.c_str()); }
     uint64_t section_end() const
     {
         return m_executable.section_address(m_section.c_str()) + m_executable.section_size(m_section.c_str());
     }
-    const std::map<uint64_t, std::string> &labels() const { return m_labels; }
+    const LabelTable &labels() const { return m_labels; }
+    /**
+     * Name to use for an address, symbols from the executable first then this function's local labels.
+     * Labels are kept local so functions can be dissassembled concurrently and in any order.
+     */
+    const char *symbol_name(uint64_t address);
+    /**
+     * Local label only, empty if there isn't one. Label names are formatted on demand into a buffer owned by the
+     * function, so the result is only valid until the next call to symbol_name or label_name.
+     */
+    const char *label_name(uint64_t address) const;
+    /**
+     * Symbol lookups made on the executable while formatting go through these so they can be recorded for later
+     * checks on whether the output would still be the same, see set_record_lookups.
+     */
+    Executable::Symbol find_symbol(uint64_t address)
+    {
+        if (m_recordLookups) {
+            m_lookups.push_back({address, false});
+        }
+
+        return m_executable.get_symbol(address);
+    }
+
+    Executable::Symbol find_nearest_symbol(uint64_t address)
+    {
+        if (m_recordLookups) {
+            m_lookups.push_back({address, true});
+        }
+
+        return m_executable.get_nearest_symbol(address);
+    }
+
+    void set_record_lookups(bool record) { m_recordLookups = record; }
+    const std::vector<SymbolLookup> &lookups() const { return m_lookups; } // Lookups made by the last disassemble.
+    const std::vector<Instruction> &instructions() const { return m_instructions; }
+    const std::vector<JumpTable> &jump_tables() const { return m_jumpTables; }
     const Executable &executable() const { return m_executable; }
+    const FunctionSetup &setup() const { return *m_setup; }
+    /**
+     * Checks whether the last of count decoded instructions is a jump through a table and how many entries the table
+     * has, looking back over the instructions before it for the bound check. Without a bound, entries are taken for
+     * as long as they point between start and end inclusive.
+     */
+    static bool find_jump_table(const Executable &exe, ZydisMachineMode mode, const DecodedInstruction *decoded,
+        size_t count, uint64_t start, uint64_t end, JumpTable &table);
+    static const uint8_t *table_data(const Executable &exe, uint64_t address, uint64_t size); // Null unless in one section.
+    static uint64_t table_entry(const uint8_t *entry, uint32_t entry_size); // Value of a 1, 4 or 8 byte entry.
+
+private:
+    struct Reference
+    {
+        uint64_t address;
+        ReferenceTypes type;
+    };
+
+    /**
+     * Decode and format are specialised on machine mode and output style so nothing inside their loops branches on
+     * either. Every mode other than 64 bit long mode uses the 32 bit version.
+     */
+    template<ZydisMachineMode Mode> void decode(const uint8_t *section_data, uint64_t section_size);
+    template<ZydisMachineMode Mode>
+    static bool find_jump_table(const Executable &exe, const DecodedInstruction *decoded, size_t count, uint64_t start,
+        uint64_t end, JumpTable &table);
+    void add_jump_table(const JumpTable &table);
+    uint64_t next_table_start(uint64_t address) const; // First table inside the function's code at or after address.
+    uint64_t add_table_entries(uint64_t address); // Adds the entries of the table at address, returns its size.
+    const uint8_t *table_data(uint64_t address, uint64_t size) const { return table_data(m_executable, address, size); }
+    template<bool Masm> void format(OutputSink &output);
+    void resolve_dependencies();
 
 private:
-    std::map<uint64_t, std::string> m_labels; // Map of labels this function uses internally.
-    std::vector<std::string> m_deps; // Symbols this function depends on.
-    std::string m_dissassembly; // Dissassembly buffer for this function.
+    LabelTable m_labels; // Labels this function uses internally.
+    mutable char m_labelName[LabelTable::MAX_NAME_LENGTH]; // Last name returned by label_name.
+    std::vector<Instruction> m_instructions; // Everything in the function in address order, decoded once.
+    // Full decode of each instruction. ZydisFormatterFormatInstruction and the jump table scan both need the whole
+    // decoded instruction and its operands, keeping them avoids decoding every instruction a second time.
+    std::vector<DecodedInstruction> m_decoded;
+    std::vector<JumpTable> m_jumpTables;
+    std::vector<Dependency> m_deps; // Symbols this function depends on.
+    std::vector<Reference> m_references; // Unnamed addresses referenced, resolved into m_deps after formatting.
+    std::vector<SymbolLookup> m_lookups;
+    std::string m_dissassembly; // Dissassembly buffer, only filled when not streaming to a sink.
     const std::string m_section;
+    const Executable::SectionInfo *m_sectionInfo;
     const uint64_t m_startAddress; // Runtime start address of the function.
     const uint64_t m_endAddress; // Runtime end address of the function.
+    uint64_t m_readEnd;
     Executable &m_executable;
+    const FunctionSetup *m_setup; // Setup in use while disassemble is running.
+    bool m_recordLookups;
+};
+
+/**
+ * Decoder and formatter state for one machine mode and output format.
+ * Building it is expensive, so create it once and reuse it for every function disassembled with the same settings.
+ * It is not modified once constructed so can be shared between threads.
+ */
+class FunctionSetup
+{
+public:
+    FunctionSetup(Function::AsmFormat format = Function::FORMAT_DEFAULT,
+        ZydisMachineMode mode = ZYDIS_MACHINE_MODE_LEGACY_32);
+    /**
+     * Decodes a single instruction and its visible operands.
+     */
+    ZyanStatus decode(
+        const void *buffer, ZyanUSize length, ZydisDecodedInstruction *info, ZydisDecodedOperand *operands) const;
+    /**
+     * Formats a previously decoded instruction, user_data is passed through to the formatter hooks.
+     */
+    ZyanStatus format_instruction(const ZydisDecodedInstruction *info, const ZydisDecodedOperand *operands,
+        ZyanU64 runtime_address, char *buffer, ZyanUSize length, void *user_data) const;
+    Function::AsmFormat format() const { return m_format; }
+    ZydisMachineMode machine_mode() const { return m_machineMode; }
+
+public:
+    // Formatter functions our hooks replaced, the hooks fall back to these when they have nothing to add.
+    ZydisFormatterFunc default_print_address_absolute;
+    ZydisFormatterFunc default_print_address_relative;
+    ZydisFormatterFunc default_print_immediate;
+    ZydisFormatterFunc default_print_displacement;
+    ZydisFormatterFunc default_format_operand_ptr;
+    ZydisFormatterFunc default_format_operand_mem;
+    ZydisFormatterRegisterFunc default_format_print_reg;
+
+private:
+    ZydisDecoder m_decoder;
+    ZydisFormatter m_formatter;
+    ZyanStatus m_status; // Result of initialising the decoder and formatter.
+    const Function::AsmFormat m_format;
+    const ZydisMachineMode m_machineMode;
 };
 } // namespace unassemblize
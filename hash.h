@@ -0,0 +1,25 @@
+/**
+ * @file
+ *
+ * @brief Fast non cryptographic hashing of byte ranges.
+ *
+ * @copyright Assemblize is free software: you can redistribute it and/or
+ *            modify it under the terms of the GNU General Public License
+ *            as published by the Free Software Foundation, either version
+ *            3 of the License, or (at your option) any later version.
+ *            A full copy of the GNU General Public License can be found in
+ *            LICENSE
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace unassemblize
+{
+/**
+ * 64 bit hash of a byte range, consumes 32 bytes per step across four independent lanes so large inputs hash at
+ * close to memory speed. Only meant for spotting changed content, not for anything security related.
+ */
+uint64_t hash_bytes(const void *data, size_t size, uint64_t seed = 0);
+} // namespace unassemblize
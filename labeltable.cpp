@@ -0,0 +1,60 @@
+/**
+ * @file
+ *
+ * @brief Set of local label addresses within a single function.
+ *
+ * @copyright Assemblize is free software: you can redistribute it and/or
+ *            modify it under the terms of the GNU General Public License
+ *            as published by the Free Software Foundation, either version
+ *            3 of the License, or (at your option) any later version.
+ *            A full copy of the GNU General Public License can be found in
+ *            LICENSE
+ */
+#include "labeltable.h"
+#include <algorithm>
+#include <string.h>
+
+void unassemblize::LabelTable::reset(uint64_t start, uint64_t end)
+{
+    m_start = start;
+    m_end = std::max(start, end);
+    m_bits.assign(((m_end - m_start) >> 6) + 1, 0);
+}
+
+size_t unassemblize::LabelTable::size() const
+{
+    size_t count = 0;
+
+    for (auto it = m_bits.begin(); it != m_bits.end(); ++it) {
+        for (uint64_t bits = *it; bits != 0; bits &= bits - 1) {
+            ++count;
+        }
+    }
+
+    return count;
+}
+
+size_t unassemblize::LabelTable::format_name(char *buffer, uint64_t address)
+{
+    static const char digits[] = "0123456789abcdef";
+    // All 16 nibbles are converted in a fixed loop, leading zeros are dropped afterwards.
+    char hex[16];
+
+    for (int i = 15; i >= 0; --i) {
+        hex[i] = digits[address & 0xf];
+        address >>= 4;
+    }
+
+    size_t skip = 0;
+
+    while (skip < 15 && hex[skip] == '0') {
+        ++skip;
+    }
+
+    size_t length = 4 + 16 - skip;
+    memcpy(buffer, "loc_", 4);
+    memcpy(buffer + 4, hex + skip, 16 - skip);
+    buffer[length] = '\0';
+
+    return length;
+}
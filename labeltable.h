@@ -0,0 +1,70 @@
+/**
+ * @file
+ *
+ * @brief Set of local label addresses within a single function.
+ *
+ * @copyright Assemblize is free software: you can redistribute it and/or
+ *            modify it under the terms of the GNU General Public License
+ *            as published by the Free Software Foundation, either version
+ *            3 of the License, or (at your option) any later version.
+ *            A full copy of the GNU General Public License can be found in
+ *            LICENSE
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace unassemblize
+{
+/**
+ * One bit per byte of a function's address range marking where local labels are. Label names are never stored,
+ * they are formatted from the address when needed, so a function's labels cost a bit per byte whatever their number.
+ */
+class LabelTable
+{
+public:
+    static const size_t MAX_NAME_LENGTH = 21; // "loc_" and up to 16 hex digits plus the terminator.
+
+public:
+    LabelTable() : m_start(0), m_end(0) {}
+    /**
+     * Clears the table and sets the range it covers, end is the last address included.
+     */
+    void reset(uint64_t start, uint64_t end);
+    /**
+     * Marks an address as a label, addresses outside the range are ignored.
+     */
+    void add(uint64_t address)
+    {
+        if (address >= m_start && address <= m_end) {
+            uint64_t offset = address - m_start;
+            m_bits[offset >> 6] |= uint64_t(1) << (offset & 63);
+        }
+    }
+
+    bool contains(uint64_t address) const
+    {
+        if (address < m_start || address > m_end) {
+            return false;
+        }
+
+        uint64_t offset = address - m_start;
+
+        return (m_bits[offset >> 6] >> (offset & 63)) & 1;
+    }
+
+    size_t size() const; // Number of labels set.
+    /**
+     * Writes the label name for an address to buffer, which must hold MAX_NAME_LENGTH characters.
+     * Returns the length of the name, not counting the terminator.
+     */
+    static size_t format_name(char *buffer, uint64_t address);
+
+private:
+    std::vector<uint64_t> m_bits;
+    uint64_t m_start;
+    uint64_t m_end;
+};
+} // namespace unassemblize
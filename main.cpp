@@ -10,12 +10,19 @@
  *            A full copy of the GNU General Public License can be found in
  *            LICENSE
  */
+#include "configdb.h"
+#include "depgraph.h"
+#include "discovery.h"
 #include "function.h"
 #include "gitinfo.h"
 #include <LIEF/LIEF.hpp>
+#include <chrono>
+#include <errno.h>
 #include <getopt.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <strings.h>
 
 void print_help()
@@ -41,9 +48,32 @@ void print_help()
         "                  hexidecimal notation.\n"
         "  -e --end        Ending address of a single function to dissassemble in\n"
         "                  hexidecimal notation.\n"
+        "  -a --all        Dissassemble every function with a known symbol in the code\n"
+        "                  sections instead of a single function.\n"
+        "  -j --jobs       Number of threads to use with --all or --split, 0 uses one\n"
+        "                  per CPU. At most four per CPU are used.\n"
+        "                  Output is the same whatever the number. Default: 1\n"
         "  -v --verbose    Verbose output on current state of the program.\n"
         "  --section       Section to target for dissassembly, defaults to '.text'.\n"
+        "  --split         Directory to write one .S file per object listed in the\n"
+        "                  config into, instead of the single output file.\n"
         "  --listsections  Prints a list of sections in the exe then exits.\n"
+        "  --discover      Finds functions by following calls and jumps from the entry\n"
+        "                  point and known symbols, then saves them to the config file.\n"
+        "  --scan          Also seed --discover with a scan of the code sections for\n"
+        "                  common function prologues. Implies --discover.\n"
+        "  --cache         Directory to keep snapshots of parsed executables in, repeat\n"
+        "                  runs over an unchanged file then skip parsing it. Output of\n"
+        "                  each function is kept there too and reused while its bytes\n"
+        "                  and the symbols it refers to are unchanged.\n"
+        "  --convert       Converts the config file to the given file then exits, files\n"
+        "                  ending in .db use the binary database format, others JSON.\n"
+        "  --compact       Folds the config file's journal of symbols found by earlier\n"
+        "                  runs back into the config file then exits.\n"
+        "  --deps          Writes what each dissassembled function references to the\n"
+        "                  given file, .dot and .json files are written as text, others\n"
+        "                  in the binary graph format.\n"
+        "  --timings       Prints the time each phase of the run took to stderr.\n"
         "  -d --dumpsyms   Dumps symbols stored in the executable to the config file.\n"
         "                  then exits.\n"
         "  -h --help       Displays this help.\n\n",
@@ -60,6 +90,79 @@ void print_sections(unassemblize::Executable &exe)
     }
 }
 
+/**
+ * Reports the wall time of each phase of a run as "timing <phase> <seconds>" lines on stderr, which stay apart from
+ * any output written to stdout.
+ */
+class PhaseTimer
+{
+    using Clock = std::chrono::steady_clock;
+
+public:
+    PhaseTimer() : m_enabled(false), m_start(Clock::now()), m_phaseStart(m_start) {}
+    void set_enabled(bool enabled) { m_enabled = enabled; }
+
+    void end_phase(const char *phase)
+    {
+        Clock::time_point now = Clock::now();
+        print(phase, now - m_phaseStart);
+        m_phaseStart = now;
+    }
+
+    void end_run() { print("total", Clock::now() - m_start); }
+
+private:
+    void print(const char *phase, Clock::duration elapsed) const
+    {
+        if (m_enabled) {
+            fprintf(stderr, "timing %s %.6f\n", phase, std::chrono::duration<double>(elapsed).count());
+        }
+    }
+
+private:
+    bool m_enabled;
+    Clock::time_point m_start;
+    Clock::time_point m_phaseStart;
+};
+
+bool convert_config(const char *input, const char *output)
+{
+    unassemblize::ConfigDatabase db;
+    bool loaded = unassemblize::ConfigDatabase::is_database(input) ? db.load(input) : db.load_json(input);
+
+    if (!loaded) {
+        printf("Failed to load config file '%s'.\n", input);
+        return false;
+    }
+
+    bool saved = unassemblize::ConfigDatabase::is_database(output) ? db.save(output) : db.save_json(output);
+
+    if (!saved) {
+        printf("Failed to save config file '%s'.\n", output);
+    }
+
+    return saved;
+}
+
+/**
+ * Parses the --jobs argument, which has to be a whole number that ThreadPool can take.
+ */
+bool parse_jobs(const char *str, unsigned &jobs)
+{
+    char *end;
+    errno = 0;
+    long long value = strtoll(str, &end, 10);
+
+    if (end == str || *end != '\0' || errno == ERANGE || value < 0 || value > UINT_MAX) {
+        printf("Invalid number of jobs '%s'.\n", str);
+        return false;
+    }
+
+    jobs = unsigned(value);
+
+    return true;
+}
+
 int main(int argc, char **argv)
 {
     if (argc <= 1) {
@@ -71,11 +174,21 @@ int main(int argc, char **argv)
     const char *output = "program.S";
     const char *config_file = "config.json";
     const char *format_string = nullptr;
+    const char *split_dir = nullptr;
+    const char *cache_dir = nullptr;
+    const char *convert_file = nullptr;
+    const char *deps_file = nullptr;
     uint64_t start_addr = 0;
     uint64_t end_addr = 0;
     bool print_secs = false;
+    bool all_funcs = false;
+    bool discover = false;
+    bool scan = false;
+    bool compact = false;
+    unsigned jobs = 1;
     bool dump_syms = false;
     bool verbose = false;
+    PhaseTimer timer;
 
     while (true) {
         static struct option long_options[] = {
@@ -83,9 +196,19 @@ int main(int argc, char **argv)
             {"format", required_argument, nullptr, 'f'},
             {"start", required_argument, nullptr, 's'},
             {"end", required_argument, nullptr, 'e'},
+            {"all", no_argument, nullptr, 'a'},
+            {"jobs", required_argument, nullptr, 'j'},
             {"config", required_argument, nullptr, 'c'},
             {"section", required_argument, nullptr, 1},
             {"listsections", no_argument, nullptr, 2},
+            {"split", required_argument, nullptr, 3},
+            {"discover", no_argument, nullptr, 4},
+            {"scan", no_argument, nullptr, 5},
+            {"cache", required_argument, nullptr, 6},
+            {"convert", required_argument, nullptr, 7},
+            {"compact", no_argument, nullptr, 8},
+            {"deps", required_argument, nullptr, 9},
+            {"timings", no_argument, nullptr, 10},
             {"dumpsyms", no_argument, nullptr, 'd'},
             {"verbose", no_argument, nullptr, 'v'},
             {"help", no_argument, nullptr, 'h'},
@@ -94,7 +217,7 @@ int main(int argc, char **argv)
 
         int option_index = 0;
 
-        int c = getopt_long(argc, argv, "+dhv?o:f:s:e:c:", long_options, &option_index);
+        int c = getopt_long(argc, argv, "+adhv?o:f:s:e:c:j:", long_options, &option_index);
 
         if (c == -1) {
             break;
@@ -107,6 +230,31 @@ int main(int argc, char **argv)
             case 2:
                 print_secs = true;
                 break;
+            case 3:
+                split_dir = optarg;
+                break;
+            case 4:
+                discover = true;
+                break;
+            case 5:
+                scan = true;
+                discover = true;
+                break;
+            case 6:
+                cache_dir = optarg;
+                break;
+            case 7:
+                convert_file = optarg;
+                break;
+            case 8:
+                compact = true;
+                break;
+            case 9:
+                deps_file = optarg;
+                break;
+            case 10:
+                timer.set_enabled(true);
+                break;
             case 'd':
                 dump_syms = true;
                 break;
@@ -122,6 +270,14 @@ int main(int argc, char **argv)
             case 'e':
                 end_addr = strtoull(optarg, nullptr, 16);
                 break;
+            case 'a':
+                all_funcs = true;
+                break;
+            case 'j':
+                if (!parse_jobs(optarg, jobs)) {
+                    return -1;
+                }
+                break;
             case 'c':
                 config_file = optarg;
                 break;
@@ -144,6 +300,10 @@ int main(int argc, char **argv)
         }
     }
 
+    if (convert_file != nullptr) {
+        return convert_config(config_file, convert_file) ? 0 : -1;
+    }
+
     if (verbose) {
         printf("Parsing executable file '%s'...\n", argv[optind]);
     }
@@ -159,7 +319,8 @@ int main(int argc, char **argv)
         }
     }
 
-    unassemblize::Executable exe(argv[optind], format, verbose);
+    unassemblize::Executable exe(argv[optind], format, verbose, cache_dir);
+    timer.end_phase("load");
 
     if (print_secs) {
         print_sections(exe);
@@ -172,14 +333,73 @@ int main(int argc, char **argv)
     }
 
     exe.load_config(config_file);
+    timer.end_phase("config");
+
+    if (compact) {
+        exe.compact_config(config_file);
+        return 0;
+    }
+
+    if (discover) {
+        if (verbose) {
+            printf("Discovering functions...\n");
+        }
+
+        unassemblize::Discovery discovery(exe, exe.machine_mode());
+        discovery.add_default_seeds();
+
+        if (scan) {
+            discovery.add_scanned_seeds();
+        }
+
+        discovery.run();
+        discovery.apply();
+
+        if (verbose) {
+            printf("Found %zu functions.\n", discovery.functions().size());
+        }
+
+        exe.save_config(config_file);
+        timer.end_phase("discover");
+    }
+
+    unassemblize::DependencyGraph graph;
+
+    if (deps_file != nullptr) {
+        exe.set_dependency_graph(&graph);
+    }
+
+    if (split_dir != nullptr) {
+        exe.dissassemble_objects(split_dir, jobs);
+    } else {
+        FILE *fp = nullptr;
+        if (output != nullptr) {
+            fp = fopen(output, "w+");
+        }
+
+        fprintf(fp, ".intel_syntax noprefix\n\n");
+
+        if (all_funcs) {
+            exe.dissassemble_all(fp, jobs);
+        } else {
+            exe.dissassemble_function(fp, section_name, start_addr, end_addr);
+        }
+
+        fflush(fp);
+    }
+
+    timer.end_phase("disassemble");
+
+    if (deps_file != nullptr && !graph.save(deps_file, exe)) {
+        printf("Failed to write dependency graph '%s'.\n", deps_file);
+        return -1;
+    }
 
-    FILE *fp = nullptr;
-    if (output != nullptr) {
-        fp = fopen(output, "w+");
+    if (deps_file != nullptr) {
+        timer.end_phase("deps");
     }
 
-    fprintf(fp, ".intel_syntax noprefix\n\n");
-    exe.dissassemble_function(fp, section_name, start_addr, end_addr);
+    timer.end_run();
 
     return 0;
 }
@@ -0,0 +1,44 @@
+/**
+ * @file
+ *
+ * @brief Read only memory mapping of an input file.
+ *
+ * @copyright Assemblize is free software: you can redistribute it and/or
+ *            modify it under the terms of the GNU General Public License
+ *            as published by the Free Software Foundation, either version
+ *            3 of the License, or (at your option) any later version.
+ *            A full copy of the GNU General Public License can be found in
+ *            LICENSE
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace unassemblize
+{
+/**
+ * Maps a whole file read only, pages are only read from disk when something touches them.
+ */
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    bool open(const char *file_name);
+    void close();
+    bool is_open() const { return m_data != nullptr; }
+    const uint8_t *data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+private:
+    const uint8_t *m_data;
+    size_t m_size;
+#ifdef _WIN32
+    void *m_file;
+    void *m_mapping;
+#endif
+};
+} // namespace unassemblize
@@ -0,0 +1,104 @@
+/**
+ * @file
+ *
+ * @brief Buffered destinations for dissassembly output.
+ *
+ * @copyright Assemblize is free software: you can redistribute it and/or
+ *            modify it under the terms of the GNU General Public License
+ *            as published by the Free Software Foundation, either version
+ *            3 of the License, or (at your option) any later version.
+ *            A full copy of the GNU General Public License can be found in
+ *            LICENSE
+ */
+#include "outputsink.h"
+#include <errno.h>
+#include <fcntl.h>
+
+#ifdef _WIN32
+#include <io.h>
+#include <sys/stat.h>
+#define write_fd _write
+#define close_fd _close
+#else
+#include <unistd.h>
+#define write_fd ::write
+#define close_fd ::close
+#endif
+
+unassemblize::OutputSink::OutputSink(size_t capacity) : m_buffer(new char[capacity]), m_capacity(capacity), m_used(0) {}
+
+void unassemblize::OutputSink::flush()
+{
+    if (m_used != 0) {
+        drain(m_buffer.get(), m_used);
+        m_used = 0;
+    }
+}
+
+void unassemblize::OutputSink::write_slow(const char *data, size_t size)
+{
+    flush();
+
+    // Anything as big as the buffer goes out directly rather than being copied through it.
+    if (size >= m_capacity) {
+        drain(data, size);
+        return;
+    }
+
+    memcpy(m_buffer.get(), data, size);
+    m_used = size;
+}
+
+unassemblize::FileSink::FileSink(const char *file_name, size_t capacity) :
+    OutputSink(capacity), m_owned(true), m_failed(false)
+{
+#ifdef _WIN32
+    m_fd = _open(file_name, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    m_fd = ::open(file_name, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+#endif
+}
+
+unassemblize::FileSink::FileSink(FILE *fp, size_t capacity) : OutputSink(capacity), m_owned(false), m_failed(false)
+{
+    fflush(fp);
+#ifdef _WIN32
+    m_fd = _fileno(fp);
+#else
+    m_fd = fileno(fp);
+#endif
+}
+
+unassemblize::FileSink::~FileSink()
+{
+    flush();
+
+    if (m_owned && m_fd >= 0) {
+        close_fd(m_fd);
+    }
+}
+
+void unassemblize::FileSink::drain(const char *data, size_t size)
+{
+    if (m_fd < 0 || m_failed) {
+        return;
+    }
+
+    while (size != 0) {
+        // Keep each call within what every platform accepts in one go.
+        unsigned chunk = size > 0x40000000 ? 0x40000000 : static_cast<unsigned>(size);
+        auto written = write_fd(m_fd, data, chunk);
+
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            m_failed = true;
+            return;
+        }
+
+        data += written;
+        size -= written;
+    }
+}
@@ -0,0 +1,132 @@
+/**
+ * @file
+ *
+ * @brief Buffered destinations for dissassembly output.
+ *
+ * @copyright Assemblize is free software: you can redistribute it and/or
+ *            modify it under the terms of the GNU General Public License
+ *            as published by the Free Software Foundation, either version
+ *            3 of the License, or (at your option) any later version.
+ *            A full copy of the GNU General Public License can be found in
+ *            LICENSE
+ */
+#pragma once
+
+#include <memory>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+namespace unassemblize
+{
+/**
+ * Collects text in a fixed size buffer and hands it on in large blocks, so output of any size uses the same memory.
+ * Writers can also format straight into the buffer with reserve and commit.
+ */
+class OutputSink
+{
+public:
+    explicit OutputSink(size_t capacity = 256 * 1024);
+    virtual ~OutputSink() {}
+    OutputSink(const OutputSink &) = delete;
+    OutputSink &operator=(const OutputSink &) = delete;
+
+    void write(const char *data, size_t size)
+    {
+        if (size > m_capacity - m_used) {
+            write_slow(data, size);
+            return;
+        }
+
+        memcpy(m_buffer.get() + m_used, data, size);
+        m_used += size;
+    }
+
+    void write(const char *str) { write(str, strlen(str)); }
+    void write(const std::string &str) { write(str.data(), str.size()); }
+
+    void put(char c)
+    {
+        if (m_used == m_capacity) {
+            flush();
+        }
+
+        m_buffer[m_used++] = c;
+    }
+
+    /**
+     * Space for at least size bytes to be written at the returned pointer, size must not exceed the capacity.
+     * Nothing is output until commit is called with the number of bytes actually used.
+     */
+    char *reserve(size_t size)
+    {
+        if (size > m_capacity - m_used) {
+            flush();
+        }
+
+        return m_buffer.get() + m_used;
+    }
+
+    void commit(size_t size) { m_used += size; }
+    size_t capacity() const { return m_capacity; }
+    void flush();
+
+protected:
+    virtual void drain(const char *data, size_t size) = 0;
+
+private:
+    void write_slow(const char *data, size_t size);
+
+private:
+    std::unique_ptr<char[]> m_buffer;
+    size_t m_capacity;
+    size_t m_used;
+};
+
+/**
+ * Writes straight to a file descriptor with write(2), bypassing stdio buffering.
+ */
+class FileSink : public OutputSink
+{
+public:
+    explicit FileSink(int fd, size_t capacity = 256 * 1024) : OutputSink(capacity), m_fd(fd), m_owned(false), m_failed(false)
+    {
+    }
+    /**
+     * Opens a file for writing, check is_open before using the sink.
+     */
+    explicit FileSink(const char *file_name, size_t capacity = 256 * 1024);
+    /**
+     * Writes to the file behind a stdio stream, anything already buffered in the stream is flushed first.
+     */
+    explicit FileSink(FILE *fp, size_t capacity = 256 * 1024);
+    ~FileSink() override;
+    bool is_open() const { return m_fd >= 0; }
+    bool failed() const { return m_failed; }
+
+protected:
+    void drain(const char *data, size_t size) override;
+
+private:
+    int m_fd;
+    bool m_owned;
+    bool m_failed;
+};
+
+/**
+ * Appends to a string, for callers that want the text in memory.
+ */
+class StringSink : public OutputSink
+{
+public:
+    explicit StringSink(std::string &output, size_t capacity = 4096) : OutputSink(capacity), m_output(output) {}
+    ~StringSink() override { flush(); }
+
+protected:
+    void drain(const char *data, size_t size) override { m_output.append(data, size); }
+
+private:
+    std::string &m_output;
+};
+} // namespace unassemblize
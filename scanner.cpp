@@ -0,0 +1,272 @@
+/**
+ * @file
+ *
+ * @brief Fast scan of code for likely function starts.
+ *
+ * @copyright Assemblize is free software: you can redistribute it and/or
+ *            modify it under the terms of the GNU General Public License
+ *            as published by the Free Software Foundation, either version
+ *            3 of the License, or (at your option) any later version.
+ *            A full copy of the GNU General Public License can be found in
+ *            LICENSE
+ */
+#include "scanner.h"
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SCANNER_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define SCANNER_TARGET_SSE2
+#define SCANNER_TARGET_AVX2
+#else
+#define SCANNER_TARGET_SSE2 __attribute__((target("sse2")))
+#define SCANNER_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace
+{
+const uint8_t PAD_INT3 = 0xCC;
+const uint8_t PAD_NOP = 0x90;
+const uint8_t OP_RET = 0xC3;
+const uint64_t FUNC_ALIGN = 16;
+
+bool is_padding(uint8_t byte)
+{
+    return byte == PAD_INT3 || byte == PAD_NOP;
+}
+
+bool is_push(uint8_t byte)
+{
+    return byte >= 0x50 && byte <= 0x57;
+}
+
+unsigned count_trailing_zeros(uint32_t value)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long index;
+    _BitScanForward(&index, value);
+    return index;
+#else
+    return __builtin_ctz(value);
+#endif
+}
+
+// "sub esp, imm8" at pos is only interesting as a function start when it follows register pushes that themselves
+// follow padding, a return or an aligned boundary. Walks back over the pushes to where the function would start.
+void check_sub_esp(const uint8_t *data, uint64_t pos, uint64_t address, std::vector<uint64_t> &candidates)
+{
+    uint64_t start = pos;
+
+    while (start > 0 && pos - start < 4 && is_push(data[start - 1])) {
+        --start;
+    }
+
+    if (start == pos) {
+        return;
+    }
+
+    if (start == 0 || is_padding(data[start - 1]) || data[start - 1] == OP_RET || (address + start) % FUNC_ALIGN == 0) {
+        candidates.push_back(address + start);
+    }
+}
+
+// Checks a single position, reads outside of data count as non matching bytes.
+void scan_position(const uint8_t *data, uint64_t size, uint64_t pos, uint64_t address, std::vector<uint64_t> &candidates)
+{
+    uint8_t b0 = data[pos];
+    uint8_t b1 = pos + 1 < size ? data[pos + 1] : 0;
+    uint8_t b2 = pos + 2 < size ? data[pos + 2] : 0;
+
+    if (b0 == 0x55 && ((b1 == 0x8B && b2 == 0xEC) || (b1 == 0x89 && b2 == 0xE5))) {
+        candidates.push_back(address + pos);
+    } else if (pos > 0 && is_padding(data[pos - 1]) && !is_padding(b0) && (address + pos) % FUNC_ALIGN == 0) {
+        candidates.push_back(address + pos);
+    }
+
+    if (b0 == 0x83 && b1 == 0xEC) {
+        check_sub_esp(data, pos, address, candidates);
+    }
+}
+
+void scan_scalar(const uint8_t *data, uint64_t size, uint64_t from, uint64_t to, uint64_t address,
+    std::vector<uint64_t> &candidates)
+{
+    for (uint64_t pos = from; pos < to; ++pos) {
+        scan_position(data, size, pos, address, candidates);
+    }
+}
+
+// Bit set of the positions in a block starting at pos that are on a function alignment boundary.
+uint32_t alignment_mask(uint64_t address, uint64_t pos, unsigned width)
+{
+    unsigned shift = static_cast<unsigned>((FUNC_ALIGN - (address + pos) % FUNC_ALIGN) % FUNC_ALIGN);
+    uint32_t mask = width == 32 ? 0x00010001u : 0x0001u;
+
+    return mask << shift;
+}
+
+void emit_block(const uint8_t *data, uint64_t pos, uint32_t found, uint32_t sub_esp, uint64_t address,
+    std::vector<uint64_t> &candidates)
+{
+    uint32_t bits = found | sub_esp;
+
+    while (bits != 0) {
+        unsigned bit = count_trailing_zeros(bits);
+        bits &= bits - 1;
+
+        if (found & (1u << bit)) {
+            candidates.push_back(address + pos + bit);
+        }
+
+        if (sub_esp & (1u << bit)) {
+            check_sub_esp(data, pos + bit, address, candidates);
+        }
+    }
+}
+
+#ifdef SCANNER_X86
+SCANNER_TARGET_SSE2 uint64_t scan_sse2(
+    const uint8_t *data, uint64_t size, uint64_t address, std::vector<uint64_t> &candidates)
+{
+    const __m128i push_ebp = _mm_set1_epi8(0x55);
+    const __m128i mov_8b = _mm_set1_epi8(static_cast<char>(0x8B));
+    const __m128i mov_89 = _mm_set1_epi8(static_cast<char>(0x89));
+    const __m128i ebp_esp_ec = _mm_set1_epi8(static_cast<char>(0xEC));
+    const __m128i ebp_esp_e5 = _mm_set1_epi8(static_cast<char>(0xE5));
+    const __m128i sub_83 = _mm_set1_epi8(static_cast<char>(0x83));
+    const __m128i int3 = _mm_set1_epi8(static_cast<char>(PAD_INT3));
+    const __m128i nop = _mm_set1_epi8(static_cast<char>(PAD_NOP));
+    uint64_t pos = 1;
+
+    // Each block reads from one byte before to two bytes after itself.
+    for (; pos + 16 + 2 <= size; pos += 16) {
+        __m128i prev = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + pos - 1));
+        __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + pos));
+        __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + pos + 1));
+        __m128i v2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + pos + 2));
+
+        __m128i frame = _mm_and_si128(_mm_cmpeq_epi8(v0, push_ebp),
+            _mm_or_si128(_mm_and_si128(_mm_cmpeq_epi8(v1, mov_8b), _mm_cmpeq_epi8(v2, ebp_esp_ec)),
+                _mm_and_si128(_mm_cmpeq_epi8(v1, mov_89), _mm_cmpeq_epi8(v2, ebp_esp_e5))));
+        __m128i sub_esp = _mm_and_si128(_mm_cmpeq_epi8(v0, sub_83), _mm_cmpeq_epi8(v1, ebp_esp_ec));
+        __m128i pad = _mm_or_si128(_mm_cmpeq_epi8(v0, int3), _mm_cmpeq_epi8(v0, nop));
+        __m128i pad_prev = _mm_or_si128(_mm_cmpeq_epi8(prev, int3), _mm_cmpeq_epi8(prev, nop));
+
+        uint32_t frame_bits = static_cast<uint32_t>(_mm_movemask_epi8(frame));
+        uint32_t sub_bits = static_cast<uint32_t>(_mm_movemask_epi8(sub_esp));
+        uint32_t pad_bits = static_cast<uint32_t>(_mm_movemask_epi8(_mm_andnot_si128(pad, pad_prev)))
+            & alignment_mask(address, pos, 16);
+
+        if ((frame_bits | sub_bits | pad_bits) != 0) {
+            emit_block(data, pos, frame_bits | pad_bits, sub_bits, address, candidates);
+        }
+    }
+
+    return pos;
+}
+
+SCANNER_TARGET_AVX2 uint64_t scan_avx2(
+    const uint8_t *data, uint64_t size, uint64_t address, std::vector<uint64_t> &candidates)
+{
+    const __m256i push_ebp = _mm256_set1_epi8(0x55);
+    const __m256i mov_8b = _mm256_set1_epi8(static_cast<char>(0x8B));
+    const __m256i mov_89 = _mm256_set1_epi8(static_cast<char>(0x89));
+    const __m256i ebp_esp_ec = _mm256_set1_epi8(static_cast<char>(0xEC));
+    const __m256i ebp_esp_e5 = _mm256_set1_epi8(static_cast<char>(0xE5));
+    const __m256i sub_83 = _mm256_set1_epi8(static_cast<char>(0x83));
+    const __m256i int3 = _mm256_set1_epi8(static_cast<char>(PAD_INT3));
+    const __m256i nop = _mm256_set1_epi8(static_cast<char>(PAD_NOP));
+    uint64_t pos = 1;
+
+    // Each block reads from one byte before to two bytes after itself.
+    for (; pos + 32 + 2 <= size; pos += 32) {
+        __m256i prev = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + pos - 1));
+        __m256i v0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + pos));
+        __m256i v1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + pos + 1));
+        __m256i v2 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + pos + 2));
+
+        __m256i frame = _mm256_and_si256(_mm256_cmpeq_epi8(v0, push_ebp),
+            _mm256_or_si256(_mm256_and_si256(_mm256_cmpeq_epi8(v1, mov_8b), _mm256_cmpeq_epi8(v2, ebp_esp_ec)),
+                _mm256_and_si256(_mm256_cmpeq_epi8(v1, mov_89), _mm256_cmpeq_epi8(v2, ebp_esp_e5))));
+        __m256i sub_esp = _mm256_and_si256(_mm256_cmpeq_epi8(v0, sub_83), _mm256_cmpeq_epi8(v1, ebp_esp_ec));
+        __m256i pad = _mm256_or_si256(_mm256_cmpeq_epi8(v0, int3), _mm256_cmpeq_epi8(v0, nop));
+        __m256i pad_prev = _mm256_or_si256(_mm256_cmpeq_epi8(prev, int3), _mm256_cmpeq_epi8(prev, nop));
+
+        uint32_t frame_bits = static_cast<uint32_t>(_mm256_movemask_epi8(frame));
+        uint32_t sub_bits = static_cast<uint32_t>(_mm256_movemask_epi8(sub_esp));
+        uint32_t pad_bits = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_andnot_si256(pad, pad_prev)))
+            & alignment_mask(address, pos, 32);
+
+        if ((frame_bits | sub_bits | pad_bits) != 0) {
+            emit_block(data, pos, frame_bits | pad_bits, sub_bits, address, candidates);
+        }
+    }
+
+    return pos;
+}
+#endif
+} // namespace
+
+unassemblize::PrologueScanner::PrologueScanner(Implementation impl) : m_impl(impl) {}
+
+unassemblize::PrologueScanner::Implementation unassemblize::PrologueScanner::best_implementation()
+{
+#ifdef SCANNER_X86
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuidex(info, 7, 0);
+
+    // AVX2 also needs the OS to save the ymm registers, checked through OSXSAVE and XCR0.
+    int basic[4];
+    __cpuid(basic, 1);
+
+    if ((info[1] & (1 << 5)) && (basic[2] & (1 << 27)) && (_xgetbv(0) & 0x6) == 0x6) {
+        return SCAN_AVX2;
+    }
+
+    return SCAN_SSE2;
+#else
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2")) {
+        return SCAN_AVX2;
+    }
+
+    if (__builtin_cpu_supports("sse2")) {
+        return SCAN_SSE2;
+    }
+#endif
+#endif
+    return SCAN_SCALAR;
+}
+
+void unassemblize::PrologueScanner::scan(
+    const uint8_t *data, uint64_t size, uint64_t address, std::vector<uint64_t> &candidates) const
+{
+    if (data == nullptr || size == 0) {
+        return;
+    }
+
+    size_t first = candidates.size();
+
+    // First byte has nothing before it so always goes through the scalar path, as do any left over bytes.
+    scan_position(data, size, 0, address, candidates);
+    uint64_t pos = 1;
+
+#ifdef SCANNER_X86
+    if (m_impl == SCAN_AVX2) {
+        pos = scan_avx2(data, size, address, candidates);
+    } else if (m_impl == SCAN_SSE2) {
+        pos = scan_sse2(data, size, address, candidates);
+    }
+#endif
+
+    scan_scalar(data, size, pos, size, address, candidates);
+
+    // Walking back over pushes can place a candidate before ones already found.
+    std::sort(candidates.begin() + first, candidates.end());
+    candidates.erase(std::unique(candidates.begin() + first, candidates.end()), candidates.end());
+}
@@ -0,0 +1,52 @@
+/**
+ * @file
+ *
+ * @brief Fast scan of code for likely function starts.
+ *
+ * @copyright Assemblize is free software: you can redistribute it and/or
+ *            modify it under the terms of the GNU General Public License
+ *            as published by the Free Software Foundation, either version
+ *            3 of the License, or (at your option) any later version.
+ *            A full copy of the GNU General Public License can be found in
+ *            LICENSE
+ */
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+namespace unassemblize
+{
+/**
+ * Finds candidate function starts by pattern matching raw bytes rather than decoding them.
+ * Looks for the common x86 frame setups "push ebp; mov ebp, esp" in both encodings, "sub esp, imm8" after a run of
+ * register pushes, and the first byte after int3/nop alignment padding on a 16 byte boundary.
+ * Results are only candidates, a pattern can turn up in the middle of an instruction too.
+ */
+class PrologueScanner
+{
+public:
+    enum Implementation
+    {
+        SCAN_SCALAR,
+        SCAN_SSE2,
+        SCAN_AVX2,
+    };
+
+public:
+    PrologueScanner(Implementation impl = best_implementation());
+    /**
+     * Fastest implementation the CPU we are running on supports.
+     */
+    static Implementation best_implementation();
+    Implementation implementation() const { return m_impl; }
+    /**
+     * Appends the address of every candidate in data, where data is loaded at address, to candidates.
+     * The appended addresses are sorted and unique.
+     */
+    void scan(const uint8_t *data, uint64_t size, uint64_t address, std::vector<uint64_t> &candidates) const;
+
+private:
+    Implementation m_impl;
+};
+} // namespace unassemblize
@@ -0,0 +1,124 @@
+/**
+ * @file
+ *
+ * @brief Interned string storage referred to by 32 bit ids.
+ *
+ * @copyright Assemblize is free software: you can redistribute it and/or
+ *            modify it under the terms of the GNU General Public License
+ *            as published by the Free Software Foundation, either version
+ *            3 of the License, or (at your option) any later version.
+ *            A full copy of the GNU General Public License can be found in
+ *            LICENSE
+ */
+#include "stringpool.h"
+#include <algorithm>
+
+namespace
+{
+uint32_t hash_string(const char *str, size_t length)
+{
+    // FNV-1a, names are short so this is as quick as anything fancier.
+    uint32_t hash = 2166136261u;
+
+    for (size_t i = 0; i < length; ++i) {
+        hash = (hash ^ static_cast<uint8_t>(str[i])) * 16777619u;
+    }
+
+    return hash;
+}
+} // namespace
+
+unassemblize::StringPool::StringPool() :
+    m_chunks(new std::unique_ptr<Entry[]>[MAX_CHUNKS]), m_block(nullptr), m_blockUsed(0), m_count(0), m_table(1024, 0)
+{
+    intern("", 0);
+}
+
+uint32_t unassemblize::StringPool::intern(const char *str, size_t length)
+{
+    uint32_t hash = hash_string(str, length);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    size_t mask = m_table.size() - 1;
+
+    for (size_t slot = hash & mask; m_table[slot] != 0; slot = (slot + 1) & mask) {
+        const Entry &found = entry(m_table[slot] - 1);
+
+        if (found.hash == hash && found.length == length && memcmp(found.str, str, length) == 0) {
+            return m_table[slot] - 1;
+        }
+    }
+
+    uint32_t id = m_count;
+    std::unique_ptr<Entry[]> &chunk = m_chunks[id >> CHUNK_SHIFT];
+
+    if (!chunk) {
+        chunk.reset(new Entry[CHUNK_SIZE]);
+    }
+
+    chunk[id & (CHUNK_SIZE - 1)] = {store(str, length), static_cast<uint32_t>(length), hash};
+    ++m_count;
+
+    // Kept at most half full so probe runs stay short.
+    if (m_count * 2 > m_table.size()) {
+        grow_table();
+    } else {
+        size_t slot = hash & mask;
+
+        while (m_table[slot] != 0) {
+            slot = (slot + 1) & mask;
+        }
+
+        m_table[slot] = id + 1;
+    }
+
+    return id;
+}
+
+size_t unassemblize::StringPool::size() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_count;
+}
+
+const char *unassemblize::StringPool::store(const char *str, size_t length)
+{
+    char *dst;
+
+    if (length + 1 > BLOCK_SIZE) {
+        // Strings too long to share a block get one to themselves.
+        m_blocks.emplace_back(new char[length + 1]);
+        dst = m_blocks.back().get();
+    } else {
+        if (m_block == nullptr || m_blockUsed + length + 1 > BLOCK_SIZE) {
+            m_blocks.emplace_back(new char[BLOCK_SIZE]);
+            m_block = m_blocks.back().get();
+            m_blockUsed = 0;
+        }
+
+        dst = m_block + m_blockUsed;
+        m_blockUsed += length + 1;
+    }
+
+    memcpy(dst, str, length);
+    dst[length] = '\0';
+
+    return dst;
+}
+
+void unassemblize::StringPool::grow_table()
+{
+    std::vector<uint32_t> table(m_table.size() * 2, 0);
+    size_t mask = table.size() - 1;
+
+    for (uint32_t id = 0; id < m_count; ++id) {
+        size_t slot = entry(id).hash & mask;
+
+        while (table[slot] != 0) {
+            slot = (slot + 1) & mask;
+        }
+
+        table[slot] = id + 1;
+    }
+
+    m_table.swap(table);
+}
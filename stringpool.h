@@ -0,0 +1,76 @@
+/**
+ * @file
+ *
+ * @brief Interned string storage referred to by 32 bit ids.
+ *
+ * @copyright Assemblize is free software: you can redistribute it and/or
+ *            modify it under the terms of the GNU General Public License
+ *            as published by the Free Software Foundation, either version
+ *            3 of the License, or (at your option) any later version.
+ *            A full copy of the GNU General Public License can be found in
+ *            LICENSE
+ */
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+namespace unassemblize
+{
+/**
+ * Deduplicated null terminated strings packed into large character blocks, each one named by a 32 bit id.
+ * Blocks and id entries never move once written so ids can be read on any thread while others intern new strings.
+ * Id 0 is always the empty string.
+ */
+class StringPool
+{
+public:
+    static const uint32_t empty = 0;
+
+public:
+    StringPool();
+    StringPool(const StringPool &) = delete;
+    StringPool &operator=(const StringPool &) = delete;
+    /**
+     * Id of the string, adding a copy of it if the pool doesn't have it yet.
+     */
+    uint32_t intern(const char *str, size_t length);
+    uint32_t intern(const char *str) { return intern(str, strlen(str)); }
+    uint32_t intern(const std::string &str) { return intern(str.data(), str.size()); }
+    const char *c_str(uint32_t id) const { return entry(id).str; }
+    uint32_t length(uint32_t id) const { return entry(id).length; }
+    size_t size() const;
+
+private:
+    struct Entry
+    {
+        const char *str;
+        uint32_t length;
+        uint32_t hash;
+    };
+
+    // Entries are allocated in chunks through a fixed table so existing ones stay put as the pool grows.
+    static const unsigned CHUNK_SHIFT = 14;
+    static const uint32_t CHUNK_SIZE = 1 << CHUNK_SHIFT;
+    static const uint32_t MAX_CHUNKS = 1 << 14;
+    static const size_t BLOCK_SIZE = 64 * 1024;
+
+    const Entry &entry(uint32_t id) const { return m_chunks[id >> CHUNK_SHIFT][id & (CHUNK_SIZE - 1)]; }
+    const char *store(const char *str, size_t length);
+    void grow_table();
+
+private:
+    std::unique_ptr<std::unique_ptr<Entry[]>[]> m_chunks;
+    std::vector<std::unique_ptr<char[]>> m_blocks;
+    char *m_block; // Block new strings are being added to.
+    size_t m_blockUsed;
+    uint32_t m_count;
+    std::vector<uint32_t> m_table; // Open addressed hash of id + 1, 0 for an empty slot.
+    mutable std::mutex m_mutex;
+};
+} // namespace unassemblize
@@ -0,0 +1,184 @@
+/**
+ * @file
+ *
+ * @brief Flat sorted index of symbol addresses.
+ *
+ * @copyright Assemblize is free software: you can redistribute it and/or
+ *            modify it under the terms of the GNU General Public License
+ *            as published by the Free Software Foundation, either version
+ *            3 of the License, or (at your option) any later version.
+ *            A full copy of the GNU General Public License can be found in
+ *            LICENSE
+ */
+#include "symbolindex.h"
+#include <algorithm>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+namespace
+{
+unsigned count_trailing_ones(uint64_t value)
+{
+    value = ~value;
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long index;
+    _BitScanForward64(&index, value);
+    return index;
+#else
+    return __builtin_ctzll(value);
+#endif
+}
+} // namespace
+
+void unassemblize::SymbolIndex::insert(uint64_t address, uint32_t name, uint64_t size)
+{
+    m_pending.push_back({address, name, size});
+    m_dirty.store(true, std::memory_order_release);
+}
+
+size_t unassemblize::SymbolIndex::size() const
+{
+    commit();
+    return m_addresses.size();
+}
+
+size_t unassemblize::SymbolIndex::find(uint64_t address) const
+{
+    commit();
+    size_t pos = eytzinger_lower_bound(address);
+
+    return pos < m_addresses.size() && m_addresses[pos] == address ? pos : npos;
+}
+
+size_t unassemblize::SymbolIndex::find_merged(uint64_t address) const
+{
+    size_t pos = eytzinger_lower_bound(address);
+
+    return pos < m_addresses.size() && m_addresses[pos] == address ? pos : npos;
+}
+
+size_t unassemblize::SymbolIndex::find_nearest(uint64_t address) const
+{
+    commit();
+    size_t pos = eytzinger_upper_bound(address);
+
+    return pos != 0 ? pos - 1 : npos;
+}
+
+size_t unassemblize::SymbolIndex::lower_bound(uint64_t address) const
+{
+    commit();
+    return eytzinger_lower_bound(address);
+}
+
+void unassemblize::SymbolIndex::merge() const
+{
+    std::lock_guard<std::mutex> lock(m_mergeMutex);
+
+    // Another thread may have merged while we waited.
+    if (!m_dirty.load(std::memory_order_acquire)) {
+        return;
+    }
+
+    // Stable so the first of several pending symbols for one address wins.
+    std::stable_sort(m_pending.begin(), m_pending.end(), [](const Entry &a, const Entry &b) {
+        return a.address < b.address;
+    });
+
+    size_t total = m_addresses.size() + m_pending.size();
+    std::vector<uint64_t> addresses;
+    std::vector<uint32_t> names;
+    std::vector<uint64_t> sizes;
+    addresses.reserve(total);
+    names.reserve(total);
+    sizes.reserve(total);
+
+    size_t old_pos = 0;
+    auto pending = m_pending.begin();
+
+    while (old_pos < m_addresses.size() || pending != m_pending.end()) {
+        // Existing symbols come first at equal addresses so they are kept over new ones.
+        if (pending == m_pending.end()
+            || (old_pos < m_addresses.size() && m_addresses[old_pos] <= pending->address)) {
+            addresses.push_back(m_addresses[old_pos]);
+            names.push_back(m_names[old_pos]);
+            sizes.push_back(m_sizes[old_pos]);
+            ++old_pos;
+            continue;
+        }
+
+        if (!addresses.empty() && addresses.back() == pending->address) {
+            if (sizes.back() == 0) {
+                sizes.back() = pending->size;
+            }
+        } else {
+            addresses.push_back(pending->address);
+            names.push_back(pending->name);
+            sizes.push_back(pending->size);
+        }
+
+        ++pending;
+    }
+
+    m_addresses.swap(addresses);
+    m_names.swap(names);
+    m_sizes.swap(sizes);
+    std::vector<Entry>().swap(m_pending);
+    build_eytzinger();
+    m_dirty.store(false, std::memory_order_release);
+}
+
+void unassemblize::SymbolIndex::build_eytzinger() const
+{
+    size_t count = m_addresses.size();
+    m_eytzinger.assign(count + 1, 0);
+    m_eytzingerPos.assign(count + 1, 0);
+
+    // In order walk of the implicit tree places the sorted addresses, node k has children 2k and 2k + 1.
+    size_t pos = 0;
+    size_t k = 1;
+
+    while (pos < count) {
+        while (k <= count) {
+            k *= 2;
+        }
+
+        // Back up to the deepest ancestor we haven't filled yet.
+        k >>= count_trailing_ones(k) + 1;
+        m_eytzinger[k] = m_addresses[pos];
+        m_eytzingerPos[k] = static_cast<uint32_t>(pos);
+        ++pos;
+        k = 2 * k + 1;
+    }
+}
+
+size_t unassemblize::SymbolIndex::eytzinger_lower_bound(uint64_t address) const
+{
+    size_t count = m_addresses.size();
+    size_t k = 1;
+
+    while (k <= count) {
+        k = 2 * k + (m_eytzinger[k] < address);
+    }
+
+    // Undo the right turns taken after the last left turn, which was at the answer.
+    k >>= count_trailing_ones(k) + 1;
+
+    return k != 0 ? m_eytzingerPos[k] : count;
+}
+
+size_t unassemblize::SymbolIndex::eytzinger_upper_bound(uint64_t address) const
+{
+    size_t count = m_addresses.size();
+    size_t k = 1;
+
+    while (k <= count) {
+        k = 2 * k + (m_eytzinger[k] <= address);
+    }
+
+    k >>= count_trailing_ones(k) + 1;
+
+    return k != 0 ? m_eytzingerPos[k] : count;
+}
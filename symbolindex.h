@@ -0,0 +1,98 @@
+/**
+ * @file
+ *
+ * @brief Flat sorted index of symbol addresses.
+ *
+ * @copyright Assemblize is free software: you can redistribute it and/or
+ *            modify it under the terms of the GNU General Public License
+ *            as published by the Free Software Foundation, either version
+ *            3 of the License, or (at your option) any later version.
+ *            A full copy of the GNU General Public License can be found in
+ *            LICENSE
+ */
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace unassemblize
+{
+/**
+ * Symbols stored as parallel arrays sorted by address, searched through a copy of the addresses in Eytzinger (BFS)
+ * order so lookups walk down the array with no unpredictable branches and good cache use near the top.
+ * Inserts are queued and merged in one go on the next lookup, so loading many symbols costs one sort.
+ * Lookups may run concurrently with each other but not with inserts.
+ */
+class SymbolIndex
+{
+public:
+    static const size_t npos = SIZE_MAX;
+
+public:
+    SymbolIndex() : m_dirty(false) {}
+    SymbolIndex(const SymbolIndex &) = delete;
+    SymbolIndex &operator=(const SymbolIndex &) = delete;
+    /**
+     * Queues a symbol to be added. If the address already has a symbol the first one added is kept, though it takes
+     * the size of the new one if it didn't have a size of its own.
+     */
+    void insert(uint64_t address, uint32_t name, uint64_t size);
+    void reserve(size_t count) { m_pending.reserve(count); }
+    size_t size() const;
+    bool empty() const { return size() == 0; }
+    /**
+     * Position of the symbol at exactly this address, npos if there isn't one.
+     */
+    size_t find(uint64_t address) const;
+    /**
+     * As find but only looks at symbols already merged, so it doesn't merge queued inserts first.
+     */
+    size_t find_merged(uint64_t address) const;
+    /**
+     * Position of the symbol with the highest address not above this one, npos if there isn't one.
+     */
+    size_t find_nearest(uint64_t address) const;
+    /**
+     * Position of the first symbol at or above this address, size() if there isn't one.
+     */
+    size_t lower_bound(uint64_t address) const;
+    uint64_t address(size_t pos) const { return m_addresses[pos]; }
+    uint32_t name(size_t pos) const { return m_names[pos]; }
+    uint64_t symbol_size(size_t pos) const { return m_sizes[pos]; }
+
+private:
+    struct Entry
+    {
+        uint64_t address;
+        uint32_t name;
+        uint64_t size;
+    };
+
+    void commit() const
+    {
+        if (m_dirty.load(std::memory_order_acquire)) {
+            merge();
+        }
+    }
+
+    void merge() const;
+    void build_eytzinger() const;
+    size_t eytzinger_lower_bound(uint64_t address) const;
+    size_t eytzinger_upper_bound(uint64_t address) const;
+
+private:
+    // Sorted by address, same position in each is the same symbol.
+    mutable std::vector<uint64_t> m_addresses;
+    mutable std::vector<uint32_t> m_names;
+    mutable std::vector<uint64_t> m_sizes;
+    // Addresses in Eytzinger order from index 1 and the sorted position each one came from.
+    mutable std::vector<uint64_t> m_eytzinger;
+    mutable std::vector<uint32_t> m_eytzingerPos;
+    mutable std::vector<Entry> m_pending;
+    mutable std::atomic<bool> m_dirty;
+    mutable std::mutex m_mergeMutex;
+};
+} // namespace unassemblize
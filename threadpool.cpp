@@ -0,0 +1,93 @@
+/**
+ * @file
+ *
+ * @brief Work stealing thread pool for running batches of independent tasks.
+ *
+ * @copyright Assemblize is free software: you can redistribute it and/or
+ *            modify it under the terms of the GNU General Public License
+ *            as published by the Free Software Foundation, either version
+ *            3 of the License, or (at your option) any later version.
+ *            A full copy of the GNU General Public License can be found in
+ *            LICENSE
+ */
+#include "threadpool.h"
+#include <algorithm>
+#include <thread>
+
+unassemblize::ThreadPool::ThreadPool(unsigned threads) : m_threadCount(threads)
+{
+    unsigned cpus = std::max(1u, std::thread::hardware_concurrency());
+
+    if (m_threadCount == 0) {
+        m_threadCount = cpus;
+    }
+
+    // Each thread gets its own queue, past a few per CPU more only adds contention.
+    m_threadCount = std::min(m_threadCount, cpus * MAX_THREADS_PER_CPU);
+
+    for (unsigned i = 0; i < m_threadCount; ++i) {
+        m_queues.emplace_back(new Queue);
+    }
+}
+
+void unassemblize::ThreadPool::run(std::vector<Task> &tasks)
+{
+    std::vector<Task *> order;
+    order.reserve(tasks.size());
+
+    for (auto it = tasks.begin(); it != tasks.end(); ++it) {
+        order.push_back(&*it);
+    }
+
+    std::stable_sort(order.begin(), order.end(), [](const Task *a, const Task *b) { return a->cost > b->cost; });
+
+    // Deal largest first so every queue starts with a share of the big tasks.
+    for (size_t i = 0; i < order.size(); ++i) {
+        m_queues[i % m_threadCount]->tasks.push_back(order[i]);
+    }
+
+    if (m_threadCount == 1) {
+        worker(0);
+        return;
+    }
+
+    std::vector<std::thread> threads;
+
+    for (unsigned i = 1; i < m_threadCount; ++i) {
+        threads.emplace_back(&ThreadPool::worker, this, i);
+    }
+
+    // Calling thread does its share of the work too.
+    worker(0);
+
+    for (auto it = threads.begin(); it != threads.end(); ++it) {
+        it->join();
+    }
+}
+
+void unassemblize::ThreadPool::worker(unsigned index)
+{
+    Task *task;
+
+    while ((task = pop(index)) != nullptr) {
+        task->func();
+    }
+}
+
+unassemblize::ThreadPool::Task *unassemblize::ThreadPool::pop(unsigned index)
+{
+    // Own queue first, then try to steal the largest remaining task from each of the others in turn.
+    // Tasks are never added while running so once every queue is empty the work is done.
+    for (unsigned i = 0; i < m_threadCount; ++i) {
+        Queue &queue = *m_queues[(index + i) % m_threadCount];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+
+        if (!queue.tasks.empty()) {
+            Task *task = queue.tasks.front();
+            queue.tasks.pop_front();
+            return task;
+        }
+    }
+
+    return nullptr;
+}
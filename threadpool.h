@@ -0,0 +1,63 @@
+/**
+ * @file
+ *
+ * @brief Work stealing thread pool for running batches of independent tasks.
+ *
+ * @copyright Assemblize is free software: you can redistribute it and/or
+ *            modify it under the terms of the GNU General Public License
+ *            as published by the Free Software Foundation, either version
+ *            3 of the License, or (at your option) any later version.
+ *            A full copy of the GNU General Public License can be found in
+ *            LICENSE
+ */
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <vector>
+
+namespace unassemblize
+{
+class ThreadPool
+{
+public:
+    struct Task
+    {
+        uint64_t cost; // Rough amount of work, larger tasks are started first.
+        std::function<void()> func;
+    };
+
+public:
+    /**
+     * Creates a pool that runs tasks on the given number of threads, 0 uses one per hardware thread.
+     * The count is clamped to MAX_THREADS_PER_CPU per hardware thread.
+     */
+    explicit ThreadPool(unsigned threads = 0);
+    unsigned thread_count() const { return m_threadCount; }
+    /**
+     * Runs every task and returns once they have all finished.
+     * Tasks are dealt out to per thread queues largest first, threads that run out of work steal from the others so
+     * a few large tasks don't leave the rest of the threads idle at the end.
+     */
+    void run(std::vector<Task> &tasks);
+
+    static const unsigned MAX_THREADS_PER_CPU = 4;
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Task *> tasks;
+    };
+
+    void worker(unsigned index);
+    Task *pop(unsigned index);
+
+private:
+    unsigned m_threadCount;
+    std::vector<std::unique_ptr<Queue>> m_queues;
+};
+} // namespace unassemblize